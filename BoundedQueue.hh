@@ -0,0 +1,139 @@
+//
+//  BoundedQueue.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef BoundedQueue_hpp
+#define BoundedQueue_hpp
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+/**
+ A fixed size multi producer, multi consumer queue without locks. Every cell
+ carries a sequence number telling whether it is free for the push or filled
+ for the pop at the current position, so producers and consumers only
+ contend on their own position counter.
+ push and pop wait while the queue is full or empty. Once close is called and
+ the queue is drained, pop returns false.
+ */
+template <class T>
+class BoundedQueue {
+public:
+  // capacity is rounded up to a power of two
+  explicit BoundedQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    mask = size - 1;
+    cells.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  size_t capacity() const { return mask + 1; }
+
+  // moves value in and returns true, or returns false if the queue is full
+  bool tryPush(T& value) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells[pos & mask];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // moves the oldest element out and returns true, or false if empty
+  bool tryPop(T& value) {
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells[pos & mask];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(sequence - (pos + 1));
+      if (diff == 0) {
+        if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+    value = std::move(cell->value);
+    // leaves no moved from resources behind in the cell
+    cell->value = T();
+    cell->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  // waits until there is room
+  void push(T value) {
+    for (unsigned attempt = 0; !tryPush(value); ++attempt) {
+      backOff(attempt);
+    }
+  }
+
+  // waits for an element, false once the queue is closed and empty
+  bool pop(T& value) {
+    for (unsigned attempt = 0; !tryPop(value); ++attempt) {
+      if (closed.load(std::memory_order_acquire)) {
+        // everything pushed before close is visible now
+        return tryPop(value);
+      }
+      backOff(attempt);
+    }
+    return true;
+  }
+
+  // no more push calls will follow
+  void close() { closed.store(true, std::memory_order_release); }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  // spins shortly, then sleeps, a stage waiting on a slow neighbour should
+  // not burn the core that neighbour needs
+  static void backOff(unsigned attempt) {
+    if (attempt < 64) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask = 0;
+  alignas(64) std::atomic<size_t> enqueuePos{0};
+  alignas(64) std::atomic<size_t> dequeuePos{0};
+  alignas(64) std::atomic<bool> closed{false};
+};
+
+#endif /* BoundedQueue_hpp */
@@ -7,174 +7,677 @@
 
 #include "Cache.hh"
 #include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <mutex>
 #include <sstream>
+#include <string_view>
+#include <vector>
+
+// os
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
-using namespace cv;
 
 using json = nlohmann::json;
 
+/*
+ Cache file layout, all integers in host byte order:
+
+   CacheFileHeader
+   CacheFileRecord[recordCount]  sorted on name, bytewise
+   char strings[stringsSize]     the names, referenced by offset and length
+
+ A lookup is a binary search over the records, nothing is parsed on load.
+
+ The journal, at the cache path with ".journal" appended:
+
+   CacheJournalHeader
+   { CacheJournalRecordHeader, CacheFileRecord, char name[nameLength] } ...
+
+ Every put appends one record with a single write, so a killed process loses
+ nothing that was put. A thread of its own syncs the records to disk at most
+ a second after they were written, so the puts never wait for the disk.
+ A record is checked against its checksum on replay, a torn record at the
+ end, left by a crash while writing it, ends the replay and is cut off.
+ */
+namespace {
+
+const char cacheMagic[8] = {'R', 'D', 'F', 'C', 'A', 'C', 'H', 'E'};
+// version 1 had no file stamps
+const uint32_t cacheVersion = 2;
+
+struct CacheFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint64_t recordCount;
+  uint64_t recordsOffset;
+  uint64_t stringsOffset;
+  uint64_t stringsSize;
+};
+
+const char journalMagic[8] = {'R', 'D', 'F', 'J', 'R', 'N', 'L', '\0'};
+
+struct CacheJournalHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+};
+
+struct CacheJournalRecordHeader {
+  // the CacheFileRecord and the name
+  uint32_t size;
+  uint32_t checksum;
+};
+
+// how long a put may stay in its shard's buffer, and then in the page
+// cache, before the journal is synced
+const chrono::seconds journalSyncInterval(1);
+// a shard's buffered journal records are appended once they are this large
+const size_t journalBatchSize = 16 * 1024;
+
+// CacheFileRecord::flags
+const uint32_t hasAverageHashFlag = 1;
+const uint32_t hasPHashFlag = 2;
+const uint32_t isInvalidImageFlag = 4;
+const uint32_t hasStampFlag = 8;
+
+} // namespace
+
+struct CacheFileRecord {
+  uint64_t nameOffset;
+  uint32_t nameLength;
+  uint32_t flags;
+  uint64_t averageHash;
+  uint64_t pHash;
+  int64_t size;
+  uint64_t inode;
+  uint64_t device;
+  int64_t mtimeNs;
+};
+
+static_assert(ImageHash::wordCount == 1, "the cache file stores one word per hash");
+
+static CacheEntry recordToEntry(const CacheFileRecord& record) {
+  CacheEntry entry;
+  entry.averageHash.setWord(0, record.averageHash);
+  entry.pHash.setWord(0, record.pHash);
+  entry.hasAverageHash = (record.flags & hasAverageHashFlag) != 0;
+  entry.hasPHash = (record.flags & hasPHashFlag) != 0;
+  entry.isInvalidImage = (record.flags & isInvalidImageFlag) != 0;
+  entry.hasStamp = (record.flags & hasStampFlag) != 0;
+  entry.stamp.size = record.size;
+  entry.stamp.inode = record.inode;
+  entry.stamp.device = record.device;
+  entry.stamp.mtimeNs = record.mtimeNs;
+  return entry;
+}
+
+static CacheFileRecord entryToRecord(const CacheEntry& entry) {
+  CacheFileRecord record{};
+  record.averageHash = entry.averageHash.word(0);
+  record.pHash = entry.pHash.word(0);
+  record.flags = (entry.hasAverageHash ? hasAverageHashFlag : 0) |
+                 (entry.hasPHash ? hasPHashFlag : 0) |
+                 (entry.isInvalidImage ? isInvalidImageFlag : 0) |
+                 (entry.hasStamp ? hasStampFlag : 0);
+  record.size = entry.stamp.size;
+  record.inode = entry.stamp.inode;
+  record.device = entry.stamp.device;
+  record.mtimeNs = entry.stamp.mtimeNs;
+  return record;
+}
+
+// 32 bit FNV-1a
+static uint32_t journalChecksum(const char* data, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t res = write(fd, data, size);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += res;
+    size -= static_cast<size_t>(res);
+  }
+  return true;
+}
+
 Cache::Cache() {
 }
 
+Cache::~Cache() {
+  closeJournal();
+  unmapFile();
+}
+
+static bool jsonToHash(const json& j, ImageHash& hash) {
+  if (!j.is_array() || j.size() != ImageHash::byteCount) {
+    return false;
+  }
+
+  size_t i = 0;
+  for (auto& x : j.items()) {
+    hash.setByte(i++, x.value().get<uint8_t>());
+  }
+
+  return true;
+}
+
 void Cache::load(const string& path) {
   filePath = path;
 
-  ifstream file;
-  file.open(filePath.c_str(), ifstream::in);
-  if (file.is_open()) {
-    stringstream buffer;
-    buffer << file.rdbuf();
-
-    try {
-        auto jData = json::parse(buffer.str());
-        for (auto& v : jData.items()) {
-          auto k = v.key();
-          auto vObj = v.value();
-          
-          Mat aHash;
-          if (vObj.contains("aHash")) {
-            auto aHashArray = vObj["aHash"];
-            if (aHashArray.is_array()) {
-              Mat r(1, (int)aHashArray.size(), CV_8U);
-              int c = 0;
-              for (auto& x : aHashArray.items()) {
-                *r.ptr(0, c) = x.value().get<uchar>();
-                ++c;
-              }
-              vconcat(&r, 1, aHash);
-            }
-          }
-          
-          Mat pHash;
-          if (vObj.contains("pHash")) {
-            auto pHashArray = vObj["pHash"];
-            // TODO: extract it into a function
-            if (pHashArray.is_array()) {
-              Mat r(1, (int)pHashArray.size(), CV_8U);
-              int c = 0;
-              for (auto& x : pHashArray.items()) {
-                *r.ptr(0, c) = x.value().get<uchar>();
-                ++c;
-              }
-              vconcat(&r, 1, pHash);
-            }
-          }
-          
-          bool isInvalidImage = false;
-          if (vObj.contains("isInvalidImage")) {
-            isInvalidImage = vObj["isInvalidImage"];
-          }
-          
-          map.insert({k, {aHash, pHash, isInvalidImage}});
-        }
-        cout << "Loaded " << map.size() << " records from cache" << endl;
-    } catch (...) {
+  int fd = open(filePath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    // no cache yet, it is created on save. there may be a journal of a run
+    // which did not get that far.
+    openJournal();
+    return;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    openJournal();
+    return;
+  }
+
+  const auto size = static_cast<size_t>(info.st_size);
+  char magic[sizeof(cacheMagic)] = {};
+  if (size >= sizeof(CacheFileHeader) &&
+      pread(fd, magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic)) &&
+      memcmp(magic, cacheMagic, sizeof(magic)) == 0) {
+    if (mapFile(fd, size)) {
+      cout << "Loaded " << recordCount << " records from cache" << endl;
+    } else {
+      cerr << "Couldn't load cache file " << path << endl;
+    }
+  } else {
+    // a cache written by an older version, read it once and save it as binary
+    string text(size, '\0');
+    if (pread(fd, &text[0], size, 0) == static_cast<ssize_t>(size)) {
+      importJson(text);
+    } else {
       cerr << "Couldn't load cache file " << path << endl;
     }
   }
-  
-  file.close();
+
+  close(fd);
+  openJournal();
 }
 
-void Cache::putAverageHash(const string& name, Mat& averageHash) {
-  auto fileIterator = map.find(name);
-  CacheEntry entry;
-  if (fileIterator != map.end()) {
-    fileIterator->second.averageHash = averageHash;
-  } else {
-    CacheEntry entry;
-    entry.averageHash = averageHash;
-    map.insert({name, entry});
+bool Cache::mapFile(int fd, size_t size) {
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    cerr << "Could not map cache file \"" << filePath << "\": " << strerror(errno) << '\n';
+    return false;
   }
+
+  CacheFileHeader header;
+  memcpy(&header, data, sizeof(header));
+  const bool valid = header.version == cacheVersion &&
+                     header.recordSize == sizeof(CacheFileRecord) &&
+                     header.recordsOffset % alignof(CacheFileRecord) == 0 &&
+                     header.recordsOffset <= size &&
+                     header.recordCount <= (size - header.recordsOffset) / sizeof(CacheFileRecord) &&
+                     header.stringsOffset <= size &&
+                     header.stringsSize <= size - header.stringsOffset;
+  if (!valid) {
+    cerr << "Cache file \"" << filePath << "\" has an unknown version or is damaged, ignoring it\n";
+    munmap(data, size);
+    return false;
+  }
+
+  mappedData = data;
+  mappedSize = size;
+  records = reinterpret_cast<const CacheFileRecord*>(static_cast<const char*>(data) + header.recordsOffset);
+  recordCount = header.recordCount;
+  strings = static_cast<const char*>(data) + header.stringsOffset;
+  stringsSize = header.stringsSize;
+  return true;
 }
 
-void Cache::putPHash(const string& name, Mat& pHash) {
-  auto fileIterator = map.find(name);
-  if (fileIterator != map.end()) {
-    fileIterator->second.pHash = pHash;
-  } else {
-    CacheEntry entry;
-    entry.pHash = pHash;
-    map.insert({name, entry});
+void Cache::unmapFile() {
+  if (mappedData != nullptr) {
+    munmap(mappedData, mappedSize);
   }
+
+  mappedData = nullptr;
+  mappedSize = 0;
+  records = nullptr;
+  recordCount = 0;
+  strings = nullptr;
+  stringsSize = 0;
 }
 
-void Cache::putIsInvalidImage(const string& name, bool isInvalidImage) {
-  auto fileIterator = map.find(name);
-  if (fileIterator != map.end()) {
-    fileIterator->second.isInvalidImage = isInvalidImage;
-  } else {
-    CacheEntry entry;
-    entry.isInvalidImage = isInvalidImage;
-    map.insert({name, entry});
+string Cache::journalPath() const {
+  return filePath + ".journal";
+}
+
+void Cache::openJournal() {
+  const string path = journalPath();
+  journalFd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (journalFd < 0) {
+    cerr << "Could not open cache journal \"" << path << "\": " << strerror(errno)
+         << ", new hashes are only kept on a complete run\n";
+    return;
   }
+
+  string data;
+  struct stat info;
+  if (fstat(journalFd, &info) == 0 && info.st_size > 0) {
+    data.resize(static_cast<size_t>(info.st_size));
+    if (pread(journalFd, &data[0], data.size(), 0) != static_cast<ssize_t>(data.size())) {
+      data.clear();
+    }
+  }
+
+  CacheJournalHeader header;
+  if (data.size() < sizeof(header)) {
+    // new or cut off before the first record
+    resetJournal();
+    startJournalSync();
+    return;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (memcmp(header.magic, journalMagic, sizeof(journalMagic)) != 0 ||
+      header.version != cacheVersion || header.recordSize != sizeof(CacheFileRecord)) {
+    cerr << "Cache journal \"" << path << "\" has an unknown version, ignoring it\n";
+    resetJournal();
+    startJournalSync();
+    return;
+  }
+
+  // later records replace earlier ones for the same name, as put does
+  size_t offset = sizeof(header);
+  size_t count = 0;
+  while (offset < data.size()) {
+    CacheJournalRecordHeader recordHeader;
+    CacheFileRecord record;
+    if (data.size() - offset < sizeof(recordHeader)) {
+      break;
+    }
+    memcpy(&recordHeader, data.data() + offset, sizeof(recordHeader));
+    const char* payload = data.data() + offset + sizeof(recordHeader);
+    if (recordHeader.size < sizeof(record) ||
+        recordHeader.size > data.size() - offset - sizeof(recordHeader) ||
+        journalChecksum(payload, recordHeader.size) != recordHeader.checksum) {
+      break;
+    }
+    memcpy(&record, payload, sizeof(record));
+    if (record.nameLength != recordHeader.size - sizeof(record)) {
+      break;
+    }
+
+    string name(payload + sizeof(record), record.nameLength);
+    shardFor(name).entries[name] = recordToEntry(record);
+    offset += sizeof(recordHeader) + recordHeader.size;
+    ++count;
+  }
+
+  if (offset < data.size()) {
+    cerr << "Cut off " << data.size() - offset << " damaged bytes at the end of cache journal \"" << path << "\"\n";
+    if (ftruncate(journalFd, static_cast<off_t>(offset)) != 0) {
+      cerr << "Could not repair cache journal \"" << path << "\": " << strerror(errno) << '\n';
+      dropJournal();
+      return;
+    }
+  }
+
+  if (count > 0) {
+    cout << "Replayed " << count << " records from cache journal" << endl;
+  }
+  startJournalSync();
 }
 
-void Cache::getAverageHash(const string& name, Mat& averageHash) {
-  auto fileIterator = map.find(name);
-  if (fileIterator != map.end()) {
-    averageHash = fileIterator->second.averageHash;
+// called with the shard locked, which keeps the records of a name in the
+// order of the puts
+void Cache::appendToJournal(Shard& shard, const string& name, const CacheEntry& entry) {
+  CacheFileRecord record = entryToRecord(entry);
+  record.nameLength = static_cast<uint32_t>(name.size());
+
+  CacheJournalRecordHeader recordHeader;
+  recordHeader.size = static_cast<uint32_t>(sizeof(record) + name.size());
+  auto& buffer = shard.journalBuffer;
+  const size_t start = buffer.size();
+  buffer.resize(start + sizeof(recordHeader) + recordHeader.size);
+  char* payload = &buffer[start + sizeof(recordHeader)];
+  memcpy(payload, &record, sizeof(record));
+  memcpy(payload + sizeof(record), name.data(), name.size());
+  recordHeader.checksum = journalChecksum(payload, recordHeader.size);
+  memcpy(&buffer[start], &recordHeader, sizeof(recordHeader));
+
+  if (buffer.size() >= journalBatchSize) {
+    writeJournal(buffer);
   }
 }
 
-void Cache::getPHash(const string& name, Mat& pHash) {
-  auto fileIterator = map.find(name);
-  if (fileIterator != map.end()) {
-    pHash = fileIterator->second.pHash;
+// appends whole records in one write, so batches never interleave, and
+// empties records
+void Cache::writeJournal(string& records) {
+  lock_guard<mutex> lock(journalMutex);
+  if (journalFd >= 0) {
+    if (writeAll(journalFd, records.data(), records.size())) {
+      // synced by the journal syncer, not on the way of the put
+      journalDirty.store(true, memory_order_release);
+    } else {
+      cerr << "Could not write cache journal \"" << journalPath() << "\": " << strerror(errno) << '\n';
+      dropJournal();
+    }
   }
+  records.clear();
 }
 
-bool Cache::isInvalidImage(const string& name) {
-  auto fileIterator = map.find(name);
-  if (fileIterator != map.end()) {
-    return fileIterator->second.isInvalidImage;
-  } else {
-    return false;
+// appends the records buffered in the shards
+void Cache::flushJournal() {
+  for (auto& shard : shards) {
+    unique_lock<shared_mutex> lock(shard.mutex);
+    if (!shard.journalBuffer.empty()) {
+      writeJournal(shard.journalBuffer);
+    }
   }
 }
 
-void matFirstLineToJson(Mat& mat, json& j) {
-    for (int i = 0; i < mat.cols; ++i) {
-      j.push_back(mat.at<uchar>(0, i));
+void Cache::startJournalSync() {
+  stopJournalSync();
+  // a descriptor of its own, so the syncer never needs the journal lock and
+  // the journal can be closed while it syncs
+  const int fd = dup(journalFd);
+  if (fd < 0) {
+    return;
+  }
+  syncStopping = false;
+  journalSyncer = thread([this, fd]() {
+    unique_lock<mutex> lock(syncMutex);
+    while (!syncStopping) {
+      syncWakeup.wait_for(lock, journalSyncInterval, [this]() { return syncStopping; });
+      lock.unlock();
+      flushJournal();
+      if (journalDirty.exchange(false, memory_order_acq_rel)) {
+        fsync(fd);
+      }
+      lock.lock();
     }
+    close(fd);
+  });
 }
 
-void Cache::save() {
-  ofstream file;
-  file.open(filePath.c_str(), ios_base::out);
-  if (!file.is_open()) {
-    cerr << "Could not open cache file \"" << filePath << "\"\n";
+void Cache::stopJournalSync() {
+  if (!journalSyncer.joinable()) {
     return;
   }
-  
-  json outJson;
-  
-  for (auto& entry : map) {
-    json pj;
-    if (!entry.second.averageHash.empty()) {
-      json aHashJson;
-      matFirstLineToJson(entry.second.averageHash, aHashJson);
-      pj["aHash"] = aHashJson;
+  {
+    lock_guard<mutex> lock(syncMutex);
+    syncStopping = true;
+  }
+  syncWakeup.notify_one();
+  journalSyncer.join();
+}
+
+// empties the journal down to its header
+void Cache::resetJournal() {
+  CacheJournalHeader header{};
+  memcpy(header.magic, journalMagic, sizeof(journalMagic));
+  header.version = cacheVersion;
+  header.recordSize = sizeof(CacheFileRecord);
+  if (ftruncate(journalFd, 0) != 0 ||
+      !writeAll(journalFd, reinterpret_cast<const char*>(&header), sizeof(header)) ||
+      fsync(journalFd) != 0) {
+    cerr << "Could not reset cache journal \"" << journalPath() << "\": " << strerror(errno) << '\n';
+    dropJournal();
+    return;
+  }
+  journalDirty.store(false, memory_order_release);
+}
+
+// gives up on the journal after it failed. the syncer may be waiting for
+// the journal lock, so it is left to run on its own descriptor.
+void Cache::dropJournal() {
+  close(journalFd);
+  journalFd = -1;
+}
+
+void Cache::closeJournal() {
+  stopJournalSync();
+  flushJournal();
+  lock_guard<mutex> lock(journalMutex);
+  if (journalFd < 0) {
+    return;
+  }
+  if (journalDirty.exchange(false, memory_order_acq_rel)) {
+    fsync(journalFd);
+  }
+  close(journalFd);
+  journalFd = -1;
+}
+
+Cache::Shard& Cache::shardFor(const string& name) {
+  return shards[hash<string>()(name) % shardCount];
+}
+
+const Cache::Shard& Cache::shardFor(const string& name) const {
+  return shards[hash<string>()(name) % shardCount];
+}
+
+void Cache::importJson(const string& text) {
+  try {
+      size_t count = 0;
+      auto jData = json::parse(text);
+      for (auto& v : jData.items()) {
+        auto k = v.key();
+        auto vObj = v.value();
+        
+        CacheEntry entry;
+        if (vObj.contains("aHash")) {
+          entry.hasAverageHash = jsonToHash(vObj["aHash"], entry.averageHash);
+        }
+
+        if (vObj.contains("pHash")) {
+          entry.hasPHash = jsonToHash(vObj["pHash"], entry.pHash);
+        }
+
+        if (vObj.contains("isInvalidImage")) {
+          entry.isInvalidImage = vObj["isInvalidImage"];
+        }
+        
+        shardFor(k).entries.insert({k, entry});
+        ++count;
+      }
+      cout << "Imported " << count << " records from json cache" << endl;
+  } catch (...) {
+    cerr << "Couldn't load cache file " << filePath << endl;
+  }
+}
+
+bool Cache::findEntry(const string& name, CacheEntry& entry) const {
+  {
+    const auto& shard = shardFor(name);
+    shared_lock<shared_mutex> lock(shard.mutex);
+    auto fileIterator = shard.entries.find(name);
+    if (fileIterator != shard.entries.end()) {
+      entry = fileIterator->second;
+      return true;
     }
-    
-    if (!entry.second.pHash.empty()) {
-      json pHashJson;
-      matFirstLineToJson(entry.second.pHash, pHashJson);
-      pj["pHash"] = pHashJson;
+  }
+
+  auto recordName = [this](const CacheFileRecord& r) {
+    if (r.nameOffset > stringsSize || r.nameLength > stringsSize - r.nameOffset) {
+      return string_view();
     }
-    
-    if (entry.second.isInvalidImage) {
-      pj["isInvalidImage"] = true;
+    return string_view(strings + r.nameOffset, r.nameLength);
+  };
+
+  auto it = lower_bound(records, records + recordCount, string_view(name), [&recordName](const CacheFileRecord& r, string_view n) {
+    return recordName(r) < n;
+  });
+
+  if (it != records + recordCount && recordName(*it) == name) {
+    entry = recordToEntry(*it);
+    return true;
+  }
+
+  return false;
+}
+
+bool Cache::get(const string& name, const FileStamp& stamp, CacheEntry& entry) const {
+  if (!findEntry(name, entry)) {
+    return false;
+  }
+
+  if (entry.hasStamp) {
+    return entry.stamp == stamp;
+  }
+
+  // from a cache without stamps. the hashes are trusted once, but an invalid
+  // image may have been a partially written file, so check it again.
+  return !entry.isInvalidImage;
+}
+
+void Cache::put(const string& name, const CacheEntry& entry) {
+  auto& shard = shardFor(name);
+  unique_lock<shared_mutex> lock(shard.mutex);
+  shard.entries[name] = entry;
+  appendToJournal(shard, name, entry);
+}
+
+// syncs the directory holding path, so that a rename to path is on disk
+static bool syncParentDirectory(const string& path) {
+  const auto slash = path.rfind('/');
+  const string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+  const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return false;
+  }
+  const bool synced = fsync(fd) == 0;
+  close(fd);
+  return synced;
+}
+
+void Cache::save() {
+  // the changed entries in name order
+  vector<const pair<const string, CacheEntry>*> changed;
+  for (auto& shard : shards) {
+    for (auto& entry : shard.entries) {
+      changed.push_back(&entry);
+    }
+  }
+  sort(changed.begin(), changed.end(), [](const pair<const string, CacheEntry>* a, const pair<const string, CacheEntry>* b) {
+    return a->first < b->first;
+  });
+
+  // merge the mapped records with the changed entries, both are sorted on name
+  vector<CacheFileRecord> outRecords;
+  string outStrings;
+  auto append = [&outRecords, &outStrings](string_view name, CacheFileRecord record) {
+    if ((record.flags & ~hasStampFlag) == 0) {
+      return;
     }
-    
-    if (!pj.empty()) {
-      outJson[entry.first] = pj;
+    record.nameOffset = outStrings.size();
+    record.nameLength = static_cast<uint32_t>(name.size());
+    outStrings.append(name.data(), name.size());
+    outRecords.push_back(record);
+  };
+
+  size_t r = 0;
+  for (auto entryPointer : changed) {
+    const auto& entry = *entryPointer;
+    for (; r < recordCount; ++r) {
+      const auto& record = records[r];
+      if (record.nameOffset > stringsSize || record.nameLength > stringsSize - record.nameOffset) {
+        continue;
+      }
+      const string_view name(strings + record.nameOffset, record.nameLength);
+      if (name >= entry.first) {
+        if (name == entry.first) {
+          ++r;
+        }
+        break;
+      }
+      append(name, record);
     }
+    append(entry.first, entryToRecord(entry.second));
   }
 
-  file << outJson.dump();
+  for (; r < recordCount; ++r) {
+    const auto& record = records[r];
+    if (record.nameOffset <= stringsSize && record.nameLength <= stringsSize - record.nameOffset) {
+      append(string_view(strings + record.nameOffset, record.nameLength), record);
+    }
+  }
+
+  CacheFileHeader header{};
+  memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+  header.version = cacheVersion;
+  header.recordSize = sizeof(CacheFileRecord);
+  header.recordCount = outRecords.size();
+  header.recordsOffset = sizeof(CacheFileHeader);
+  header.stringsOffset = header.recordsOffset + outRecords.size() * sizeof(CacheFileRecord);
+  header.stringsSize = outStrings.size();
+
+  // write next to the old file and rename, so a crash never leaves half a cache
+  const string tmpPath = filePath + ".tmp";
+  ofstream file;
+  file.open(tmpPath.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+  if (!file.is_open()) {
+    cerr << "Could not open cache file \"" << tmpPath << "\"\n";
+    return;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(outRecords.data()), static_cast<streamsize>(outRecords.size() * sizeof(CacheFileRecord)));
+  file.write(outStrings.data(), static_cast<streamsize>(outStrings.size()));
   file.close();
+  if (!file) {
+    cerr << "Could not write cache file \"" << tmpPath << "\"\n";
+    remove(tmpPath.c_str());
+    return;
+  }
+
+  // the table has to be on disk before the journal holding the same entries
+  // is emptied
+  bool synced = false;
+  const int tmpFd = open(tmpPath.c_str(), O_RDONLY);
+  if (tmpFd >= 0) {
+    synced = fsync(tmpFd) == 0;
+    close(tmpFd);
+  }
+
+  if (rename(tmpPath.c_str(), filePath.c_str()) != 0) {
+    cerr << "Could not replace cache file \"" << filePath << "\": " << strerror(errno) << '\n';
+    return;
+  }
+  // and so has the rename, which is in the directory
+  synced = synced && syncParentDirectory(filePath);
+  if (!synced) {
+    cerr << "Could not sync cache file \"" << filePath << "\", keeping its journal\n";
+    return;
+  }
+
+  // everything in the journal and its buffers is in the table now
+  for (auto& shard : shards) {
+    unique_lock<shared_mutex> lock(shard.mutex);
+    shard.journalBuffer.clear();
+  }
+  lock_guard<mutex> lock(journalMutex);
+  if (journalFd >= 0) {
+    resetJournal();
+  }
 }
@@ -8,37 +8,135 @@
 #ifndef Cache_hpp
 #define Cache_hpp
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
-#include <nlohmann/json.hpp>
-#include <opencv2/opencv.hpp>
+#include <thread>
+#include <unordered_map>
 
-using json = nlohmann::json;
+#include "ImageHash.hh"
+
+// what the file looked like when it was hashed
+struct FileStamp {
+  int64_t size = 0;
+  uint64_t inode = 0;
+  uint64_t device = 0;
+  int64_t mtimeNs = 0;
+
+  bool operator==(const FileStamp& other) const {
+    return size == other.size && inode == other.inode &&
+           device == other.device && mtimeNs == other.mtimeNs;
+  }
+  bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
 
 struct CacheEntry {
-  cv::Mat averageHash;
-  cv::Mat pHash;
-  bool isInvalidImage;
+  ImageHash averageHash;
+  ImageHash pHash;
+  FileStamp stamp;
+  bool hasAverageHash = false;
+  bool hasPHash = false;
+  bool isInvalidImage = false;
+  // false for entries from caches written before stamps were recorded
+  bool hasStamp = false;
 };
 
+struct CacheFileRecord;
+
+/**
+ Hashes of previously seen files, keyed by path.
+ The cache file is a binary table (see Cache.cc) which is mapped into memory
+ and searched in place, new entries are kept in a map until save() writes a
+ merged table. A cache file in the old json format is imported on load and
+ written back in the binary format on save.
+ Every entry carries the stamp of the file it was computed from, so a file
+ which was replaced or modified is hashed again on its own.
+ Each put is also recorded in a journal next to the cache file, which load
+ replays and save folds into the table. The records are buffered per shard
+ and appended in batches, when a buffer fills up or at the latest a second
+ after the put. A run which is killed before save keeps the hashes it
+ computed up to a second before.
+ get and put may be called from any number of threads. The new entries are
+ spread over shards with a lock each, the mapped file is only read.
+ load and save must not run concurrently with anything else.
+ */
 class Cache {
 private:
  std::string filePath;
-// path to entry
- std::map<std::string, CacheEntry> map;
+
+ struct Shard {
+   mutable std::shared_mutex mutex;
+   // path to entry, added or changed since load. takes precedence over the file.
+   std::unordered_map<std::string, CacheEntry> entries;
+   // journal records of puts to this shard, not appended to the journal yet
+   std::string journalBuffer;
+ };
+ static const size_t shardCount = 64;
+ std::array<Shard, shardCount> shards;
+
+ // the loaded cache file, mapped read only
+ void* mappedData = nullptr;
+ size_t mappedSize = 0;
+ const CacheFileRecord* records = nullptr;
+ size_t recordCount = 0;
+ const char* strings = nullptr;
+ size_t stringsSize = 0;
+
+ // the journal of entries put since the last save, -1 if there is none.
+ // taken after a shard lock, never before.
+ int journalFd = -1;
+ std::mutex journalMutex;
+ // written since the last sync
+ std::atomic<bool> journalDirty{false};
+ // appends the buffered records and syncs the journal every second
+ std::thread journalSyncer;
+ std::mutex syncMutex;
+ std::condition_variable syncWakeup;
+ bool syncStopping = false;
+
+ bool mapFile(int fd, size_t size);
+ void unmapFile();
+ void importJson(const std::string& text);
+ std::string journalPath() const;
+ void openJournal();
+ void appendToJournal(Shard& shard, const std::string& name, const CacheEntry& entry);
+ void writeJournal(std::string& records);
+ void flushJournal();
+ void resetJournal();
+ void dropJournal();
+ void closeJournal();
+ void startJournalSync();
+ void stopJournalSync();
+ bool findEntry(const std::string& name, CacheEntry& entry) const;
+ Shard& shardFor(const std::string& name);
+ const Shard& shardFor(const std::string& name) const;
 
 public:
 
   Cache();
+  ~Cache();
+  Cache(const Cache&) = delete;
+  Cache& operator=(const Cache&) = delete;
   
   void load(const std::string& path);
-  void putAverageHash(const std::string& name, cv::Mat& averageHash);
-  void putPHash(const std::string& name, cv::Mat& pHash);
-  void putIsInvalidImage(const std::string& name, bool isInvalidImage);
   void save();
-  
-  void getAverageHash(const std::string& name, cv::Mat& averageHash);
-  void getPHash(const std::string& name, cv::Mat& pHash);
-  bool isInvalidImage(const std::string& name);
+
+  /**
+   * looks up the entry for name.
+   * @return false if there is none or it was stored for a file with a
+   * different stamp, meaning the file has changed since it was hashed.
+   * Entries without a stamp are returned if they hold hashes, the caller
+   * is expected to put them back with the current stamp.
+   */
+  bool get(const std::string& name, const FileStamp& stamp, CacheEntry& entry) const;
+
+  // adds or replaces the entry for name, and records it in the journal
+  void put(const std::string& name, const CacheEntry& entry);
 };
 
 
@@ -0,0 +1,20 @@
+//
+//  Checksum.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef Checksum_hpp
+#define Checksum_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * a fast non cryptographic 64 bit hash of the bytes (xxHash64). good for
+ * telling files apart, not against someone crafting collisions.
+ */
+uint64_t checksum64(const void* data, size_t size, uint64_t seed = 0);
+
+#endif /* Checksum_hpp */
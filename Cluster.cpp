@@ -6,37 +6,122 @@
 //
 
 #include "Cluster.hh"
+#include "HammingDistance.hh"
 
-void Cluster::calcDistance(Ptr<Fileinfo> f, double& outDistance) const {
-  double resultDistance = 0.0;
-  for (auto& clusterFile : files) {
-    if (!clusterFile.get()->isInvalidImage()) {
-      auto aDistance = aHashPtr->compare(f.get()->getAHash(), clusterFile.get()->getAHash());
-      auto pDistance = pHashPtr->compare(f.get()->getPHash(), clusterFile.get()->getPHash());
-      auto d = std::fmax(aDistance, pDistance);
-      resultDistance = std::fmax(resultDistance, d);
+namespace {
+
+// the member with the smallest largest distance to the others, among at most
+// maxCandidates evenly spread members
+Cluster::HashSummary summarize(const vector<uint64_t>& hashes) {
+  const size_t maxCandidates = 32;
+  Cluster::HashSummary best;
+  best.radius = numeric_limits<int>::max();
+  const size_t step = std::max<size_t>(1, hashes.size() / maxCandidates);
+  for (size_t i = 0; i < hashes.size(); i += step) {
+    const int radius = hammingMaxDistance(hashes[i], hashes.data(), hashes.size(), best.radius);
+    if (radius < best.radius) {
+      best.medoid = hashes[i];
+      best.radius = radius;
     }
   }
+  return best;
+}
 
-  outDistance = resultDistance;
+int hashDistance(uint64_t a, uint64_t b) {
+  return __builtin_popcountll(a ^ b);
 }
 
-bool Cluster::needAdd(Ptr<Fileinfo> f, double& outDistance) const {
-  calcDistance(f, outDistance);
-  return outDistance <= 3.0;
+} // namespace
+
+void Cluster::chooseMedoids() {
+  aSummary = summarize(aHashes);
+  pSummary = summarize(pHashes);
+  summarizedCount = aHashes.size();
 }
 
-void Cluster::add(Ptr<Fileinfo> f) {
-  files.push_back(f);
+bool Cluster::distanceBounds(FileTable::Id f, int& lower, int& upper) const {
+  if (aHashes.empty()) {
+    return false;
+  }
+
+  const int aToMedoid = hashDistance(table->aHash(f), aSummary.medoid);
+  const int pToMedoid = hashDistance(table->pHash(f), pSummary.medoid);
+  // the medoid is a member, so the distance to it is a lower bound as well
+  lower = std::max(std::max(aToMedoid, aSummary.radius - aToMedoid),
+                   std::max(pToMedoid, pSummary.radius - pToMedoid));
+  upper = std::max(aToMedoid + aSummary.radius, pToMedoid + pSummary.radius);
+  return true;
+}
+
+void Cluster::calcDistance(FileTable::Id f, double& outDistance) const {
+  int lower = 0;
+  int upper = 0;
+  if (distanceBounds(f, lower, upper) && lower == upper) {
+    // the file matches the medoid, or all members are the same
+    outDistance = lower;
+    return;
+  }
+
+  const int noLimit = numeric_limits<int>::max();
+  auto aDistance = hammingMaxDistance(table->aHash(f), aHashes.data(), aHashes.size(), noLimit);
+  auto pDistance = hammingMaxDistance(table->pHash(f), pHashes.data(), pHashes.size(), noLimit);
+  outDistance = std::max(aDistance, pDistance);
+}
+
+bool Cluster::needAdd(FileTable::Id f, double& outDistance) const {
+  const int limit = static_cast<int>(maxDistance);
+  int lower = 0;
+  int upper = 0;
+  if (distanceBounds(f, lower, upper)) {
+    if (lower > limit || lower == upper) {
+      // decided without looking at the members. the distance is exact when
+      // the bounds meet, it is only used when the file is added.
+      outDistance = lower;
+      return lower <= limit;
+    }
+  }
+
+  // in between the bounds only the members tell
+  auto d = hammingMaxDistance(table->aHash(f), aHashes.data(), aHashes.size(), limit);
+  if (d <= limit) {
+    d = std::max(d, hammingMaxDistance(table->pHash(f), pHashes.data(), pHashes.size(), limit));
+  }
+
+  outDistance = d;
+  return d <= limit;
 }
 
-std::vector<Ptr<Fileinfo>> Cluster::filesSortedBySize() const {
-  std::vector<Ptr<Fileinfo>> sorted = files;
-  std::sort(sorted.begin(), sorted.end(), [](const Ptr<Fileinfo>& f1, const Ptr<Fileinfo>& f2) {
-    return f2.get()->size() < f1.get()->size();
-  });
+void Cluster::add(FileTable::Id f) {
+  files.push_back(f);
+  if (table->isInvalidImage(f)) {
+    return;
+  }
+
+  const auto aHash = table->aHash(f);
+  const auto pHash = table->pHash(f);
+  aHashes.push_back(aHash);
+  pHashes.push_back(pHash);
 
-  return sorted;
+  if (aHashes.size() >= 2 * summarizedCount) {
+    // the medoid of the first members may be off center by now, pick it
+    // again each time the cluster doubled
+    chooseMedoids();
+  } else {
+    aSummary.radius = std::max(aSummary.radius, hashDistance(aHash, aSummary.medoid));
+    pSummary.radius = std::max(pSummary.radius, hashDistance(pHash, pSummary.medoid));
+  }
+}
+
+void Cluster::refreshHashes() {
+  aHashes.clear();
+  pHashes.clear();
+  for (auto& f : files) {
+    if (!table->isInvalidImage(f)) {
+      aHashes.push_back(table->aHash(f));
+      pHashes.push_back(table->pHash(f));
+    }
+  }
+  chooseMedoids();
 }
 
 bool Cluster::isSingle() const {
@@ -47,21 +132,21 @@ size_t Cluster::size() const {
   return files.size();
 }
 
-Fileinfo::filesizetype Cluster::fileSize() const {
-  Fileinfo::filesizetype size = 0;
+FileTable::filesizetype Cluster::fileSize() const {
+  FileTable::filesizetype size = 0;
   for (auto& f : files) {
-    size += f.get()->size();
+    size += table->fileSize(f);
   }
   
   return size;
 }
   
-Fileinfo::filesizetype Cluster::fileSizeWithoutBiggest() const {
-  Fileinfo::filesizetype size = 0;
-  Fileinfo::filesizetype biggestSize = 0;
+FileTable::filesizetype Cluster::fileSizeWithoutBiggest() const {
+  FileTable::filesizetype size = 0;
+  FileTable::filesizetype biggestSize = 0;
   for (auto& f : files) {
-    biggestSize = std::fmax(biggestSize, f.get()->size());
-    size += f.get()->size();
+    biggestSize = std::fmax(biggestSize, table->fileSize(f));
+    size += table->fileSize(f);
   }
   
   return size - biggestSize;
@@ -10,54 +10,85 @@
 
 #include <vector>
 #include <opencv2/opencv.hpp>
-#include <opencv2/img_hash.hpp>
 
-#include "Fileinfo.hh" //file container
+#include "FileTable.hh" //file container
 
 using namespace std;
 using namespace cv;
-using namespace cv::img_hash;
 
 struct Cluster {
+  // a file joins a cluster when it is within this distance of every member
+  static constexpr double maxDistance = 3.0;
+
+  // the table the files are rows of
+  const FileTable* table;
   string name;
-  vector<Ptr<Fileinfo>> files;
-  Ptr<ImgHashBase> aHashPtr;
-  Ptr<ImgHashBase> pHashPtr;
+  vector<FileTable::Id> files;
   double distance = 0.0;
+
+  // hashes of the valid images in files, contiguous for the distance kernels
+  vector<uint64_t> aHashes;
+  vector<uint64_t> pHashes;
+
+  // a member hash central to the cluster, and the largest distance of a
+  // member from it. by the triangle inequality the largest distance from a
+  // file to the members is between max(d, radius - d) and d + radius, with d
+  // its distance to the medoid.
+  struct HashSummary {
+    uint64_t medoid = 0;
+    int radius = 0;
+  };
+  HashSummary aSummary;
+  HashSummary pSummary;
+  // members with hashes when the medoids were chosen
+  size_t summarizedCount = 0;
   
 public:
     Cluster(
+    const FileTable& table,
     string name,
-    vector<Ptr<Fileinfo>> files,
-    Ptr<ImgHashBase> aHashPtr,
-    Ptr<ImgHashBase> pHashPtr,
+    vector<FileTable::Id> files,
     double d
     )
-        : name(name)
+        : table(&table)
+        , name(name)
         , files(files)
-        , aHashPtr(aHashPtr)
-        , pHashPtr(pHashPtr)
         , distance(d)
-    {}
+    {
+      refreshHashes();
+    }
 
-  void calcDistance(Ptr<Fileinfo> f, double& outDistance) const;
-  bool needAdd(Ptr<Fileinfo> f, double& outDistance) const;
+  void calcDistance(FileTable::Id f, double& outDistance) const;
+  bool needAdd(FileTable::Id f, double& outDistance) const;
   
-  void add(Ptr<Fileinfo> f);
-  
-  vector<Ptr<Fileinfo>> filesSortedBySize() const;
+  void add(FileTable::Id f);
+
+  // rebuilds the hash arrays, call it when the files got their hashes after being added
+  void refreshHashes();
+
+private:
+  // bounds on the largest distance from f to the members, over both hashes.
+  // false if there are no members with hashes to bound against.
+  bool distanceBounds(FileTable::Id f, int& lower, int& upper) const;
+  void chooseMedoids();
+
+public:
   
   bool isSingle() const;
   
   size_t size() const;
   
-  Fileinfo::filesizetype fileSize() const;
+  FileTable::filesizetype fileSize() const;
   
-  Fileinfo::filesizetype fileSizeWithoutBiggest() const;
+  FileTable::filesizetype fileSizeWithoutBiggest() const;
   
-  const vector<Ptr<Fileinfo>>& getFiles() const {
+  const vector<FileTable::Id>& getFiles() const {
     return files;
   }
+
+  const vector<uint64_t>& getPHashes() const {
+    return pHashes;
+  }
   
   void setDistance(double d) {
     distance = d;
@@ -70,9 +101,6 @@ public:
   const string& getName() const {
     return name;
   }
-  
-  Ptr<ImgHashBase> getAHashPtr() { return aHashPtr; }
-  Ptr<ImgHashBase> getPHashPtr() { return pHashPtr; }
 };
 
 #endif /* Cluster_hpp */
@@ -7,153 +7,315 @@
 #include "config.h"
 
 // std
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
+#include <cstddef>
 #include <cstring>
 #include <iostream>
 #include <string>
 
 // os
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 // project
 #include "Dirlist.hh"
 #include "RdfindDebug.hh" //debug macros
+#include "StatBatch.hh"
+#include "ThreadPool.hh"
 
 static const int maxdepth = 50;
 
-int
-Dirlist::walk(const std::string& dir, const int recursionlevel)
-{
+namespace {
 
-  RDDEBUG("Now in walk with dir=" << dir.c_str() << " and recursionlevel="
-                                  << recursionlevel << std::endl);
+// a directory entry as read from the directory, before stat
+struct RawEntry
+{
+  ino_t ino;
+  unsigned char type;
+  std::string name;
+};
 
-  if (recursionlevel >= maxdepth) {
-    std::cerr << "recursion limit exceeded\n";
-    return -1;
-  }
+bool
+isdotordotdot(const char* name)
+{
+  return 0 == strcmp(".", name) || 0 == strcmp("..", name);
+}
 
-  // open the directory
-  DIR* dirp = opendir(dir.c_str());
-  if (dirp == nullptr) {
-    // failed to open directory
-    RDDEBUG("failed to open directory" << std::endl);
-    // this can be due to rights, or some other error.
-    handlepossiblefile(dir, recursionlevel);
-    return 1; // it's a file (or something else)
-  }
+#ifdef __linux__
+// the layout getdents64 fills the buffer with, up to the name. the zero
+// terminated name follows d_type, in the d_reclen bytes of the entry.
+struct linux_dirent64
+{
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+};
+constexpr std::size_t direntNameOffset = offsetof(linux_dirent64, d_type) + 1;
 
-  // we opened the directory. let us read the content.
-  RDDEBUG("opened directory" << std::endl);
-  struct dirent* dp{};
-  while (nullptr != (dp = readdir(dirp))) {
-    // is the directory . or ..?
-    if (0 == strcmp(".", dp->d_name) || 0 == strcmp("..", dp->d_name)) {
-      continue;
+// reads all entries of the directory open as fd, many per system call
+bool
+readentries(int fd, std::vector<RawEntry>& entries)
+{
+  alignas(linux_dirent64) char buffer[32 * 1024];
+  while (true) {
+    const long nread = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+    if (nread < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
     }
-    // investigate what kind of file it is, dont follow any
-    // symlinks when doing this (lstat instead of stat).
-    struct stat info;
-    const int statval =
-      lstat((dir + "/" + std::string(dp->d_name)).c_str(), &info);
-    if (statval != 0) {
-      // failed to do stat
-      continue;
+    if (nread == 0) {
+      return true;
     }
-
-    // investigate what kind of item it was.
-    bool dowalk = false;
-
-    if (S_ISLNK(info.st_mode)) {
-      // symlink
-      if (m_followsymlinks) {
-        m_callback(dir, std::string(dp->d_name), recursionlevel);
-        dowalk = true;
+    for (long pos = 0; pos < nread;) {
+      const auto* d = reinterpret_cast<const linux_dirent64*>(buffer + pos);
+      const char* name = buffer + pos + direntNameOffset;
+      if (!isdotordotdot(name)) {
+        entries.push_back({static_cast<ino_t>(d->d_ino), d->d_type, name});
       }
-    } else if (S_ISDIR(info.st_mode)) {
-      // directory
-      dowalk = true;
-    } else if (S_ISREG(info.st_mode)) {
-      // regular file
-      m_callback(dir, std::string(dp->d_name), recursionlevel);
+      pos += d->d_reclen;
     }
-
-    // try to open directory
-    if (dowalk) {
-      walk(dir + "/" + dp->d_name, recursionlevel + 1);
+  }
+}
+#else
+bool
+readentries(int fd, std::vector<RawEntry>& entries)
+{
+  // fdopendir takes over the descriptor, give it a copy
+  const int dirfd = dup(fd);
+  if (dirfd < 0) {
+    return false;
+  }
+  DIR* dirp = fdopendir(dirfd);
+  if (dirp == nullptr) {
+    close(dirfd);
+    return false;
+  }
+  struct dirent* dp{};
+  while (nullptr != (dp = readdir(dirp))) {
+    if (!isdotordotdot(dp->d_name)) {
+      entries.push_back({dp->d_ino, dp->d_type, dp->d_name});
     }
+  }
+  (void)closedir(dirp);
+  return true;
+}
+#endif
 
-  } // while
+int
+opendirectory(const std::string& dir)
+{
+  int fd;
+  do {
+    fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  return fd;
+}
 
-  // close the directory
-  (void)closedir(dirp);
-  return 2; // it's a directory
+int
+statat(int dirfd, const char* name, struct stat& info, int flags)
+{
+  int res;
+  do {
+    res = fstatat(dirfd, name, &info, flags);
+  } while (res < 0 && errno == EINTR);
+  return res;
 }
 
 // splits inputstring into path and filename. if no / character is found,
 // empty string is returned as path and filename is set to inputstring.
-int
+// a file directly in / gets "/" as path, an empty one would be relative.
+void
 splitfilename(std::string& path,
               std::string& filename,
               const std::string& inputstring)
 {
-
   const auto pos = inputstring.rfind('/');
   if (pos == std::string::npos) {
     path = "";
     filename = inputstring;
-    return -1;
+    return;
   }
 
-  path = inputstring.substr(0, pos + 1);
+  path = pos == 0 ? std::string("/") : inputstring.substr(0, pos);
   filename = inputstring.substr(pos + 1, std::string::npos);
-  return 0;
 }
 
-// this function is called for files that were believed to be directories,
-// or failed re
-int
-Dirlist::handlepossiblefile(const std::string& possiblefile, int recursionlevel)
+} // namespace
+
+void
+Dirlist::walk(const std::vector<std::string>& roots,
+              const DirlistCallback& callback)
 {
+  TaskGroup group(m_pool);
+  for (std::size_t i = 0; i < roots.size(); ++i) {
+    group.run([this, &group, &callback, &roots, i]() {
+      const int fd = opendirectory(roots[i]);
+      if (fd < 0) {
+        // failed to open directory. this can be due to rights, or it is
+        // a file (or something else)
+        RDDEBUG("failed to open directory " << roots[i] << std::endl);
+        handlepossiblefile(callback, i, roots[i]);
+        return;
+      }
+      walkdirectory(group, callback, i, DirlistPosition(), fd, roots[i], 0);
+    });
+  }
+  group.wait();
+}
+
+void
+Dirlist::walkdirectory(TaskGroup& group,
+                       const DirlistCallback& callback,
+                       std::size_t rootIndex,
+                       const DirlistPosition& position,
+                       int fd,
+                       const std::string& dir,
+                       int recursionlevel)
+{
+  RDDEBUG("Now in walk with dir=" << dir.c_str() << " and recursionlevel="
+                                  << recursionlevel << std::endl);
+
+  std::vector<RawEntry> entries;
+  if (!readentries(fd, entries)) {
+    RDDEBUG("failed to read directory" << std::endl);
+    close(fd);
+    return;
+  }
+
+  // stat in inode order, which is close to on disk order for most file
+  // systems
+  std::sort(entries.begin(), entries.end(),
+            [](const RawEntry& a, const RawEntry& b) { return a.ino < b.ino; });
+
+  // investigate what kind of file each entry is, dont follow any
+  // symlinks when doing this. the stats of the directory are issued
+  // together, so they can be in flight at the same time.
+  const std::size_t noStat = SIZE_MAX;
+  std::vector<std::size_t> statIndex(entries.size(), noStat);
+  std::vector<const char*> names;
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const auto type = entries[i].type;
+    // a directory needs no stat, and fifos, sockets and devices are skipped
+    if (type == DT_REG || type == DT_LNK || type == DT_UNKNOWN) {
+      statIndex[i] = names.size();
+      names.push_back(entries[i].name.c_str());
+    }
+  }
+
+  ++m_directorycount;
+  const auto statStart = std::chrono::steady_clock::now();
+  auto& batch = StatBatch::forThread(m_batchedstat);
+  std::vector<struct stat> infos;
+  std::vector<int> results;
+  batch.statAt(fd, names, AT_SYMLINK_NOFOLLOW, infos, results);
+  m_statcount += names.size();
+
+  if (m_followsymlinks) {
+    // symlinks, classified by their target
+    std::vector<std::size_t> links;
+    std::vector<const char*> linkNames;
+    for (std::size_t j = 0; j < names.size(); ++j) {
+      if (results[j] == 0 && S_ISLNK(infos[j].st_mode)) {
+        links.push_back(j);
+        linkNames.push_back(names[j]);
+      }
+    }
+    std::vector<struct stat> linkInfos;
+    std::vector<int> linkResults;
+    batch.statAt(fd, linkNames, 0, linkInfos, linkResults);
+    m_statcount += linkNames.size();
+    for (std::size_t k = 0; k < links.size(); ++k) {
+      infos[links[k]] = linkInfos[k];
+      results[links[k]] = linkResults[k];
+    }
+  }
+  m_statnanoseconds += static_cast<std::uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - statStart)
+      .count());
+  close(fd);
 
-  RDDEBUG("Now in handlepossiblefile with name "
-          << possiblefile.c_str() << " and recursionlevel " << recursionlevel
-          << std::endl);
+  std::vector<DirlistEntry> files;
+  std::vector<std::string> subdirs;
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    auto& e = entries[i];
+    if (e.type == DT_DIR) {
+      subdirs.push_back(std::move(e.name));
+      continue;
+    }
 
-  // split filename into path and filename
-  std::string path, filename;
-  splitfilename(path, filename, possiblefile);
+    const auto j = statIndex[i];
+    if (j == noStat || results[j] != 0) {
+      // skipped, or failed to do stat
+      continue;
+    }
 
-  RDDEBUG("split filename is path=" << path.c_str() << " filename="
-                                    << filename.c_str() << std::endl);
+    const auto& info = infos[j];
+    if (S_ISDIR(info.st_mode)) {
+      subdirs.push_back(std::move(e.name));
+    } else if (S_ISREG(info.st_mode)) {
+      files.push_back({std::move(e.name), info});
+    }
+  }
+
+  if (!files.empty()) {
+    callback(rootIndex, position, dir, recursionlevel, files);
+  }
+
+  if (!subdirs.empty() && recursionlevel + 1 >= maxdepth) {
+    std::cerr << "recursion limit exceeded\n";
+    return;
+  }
+
+  for (std::size_t i = 0; i < subdirs.size(); ++i) {
+    DirlistPosition subposition(position);
+    subposition.push_back(static_cast<std::uint32_t>(i));
+    group.run([this, &group, &callback, rootIndex, recursionlevel,
+               subposition = std::move(subposition),
+               subdir = (dir.back() == '/' ? dir : dir + "/") + subdirs[i]]() {
+      const int subfd = opendirectory(subdir);
+      if (subfd >= 0) {
+        walkdirectory(group, callback, rootIndex, subposition, subfd, subdir,
+                      recursionlevel + 1);
+      }
+    });
+  }
+}
+
+// this function is called for roots that were believed to be directories
+void
+Dirlist::handlepossiblefile(const DirlistCallback& callback,
+                            std::size_t rootIndex,
+                            const std::string& possiblefile)
+{
+  RDDEBUG("Now in handlepossiblefile with name " << possiblefile.c_str()
+                                                 << std::endl);
 
   // investigate what kind of file it is, dont follow symlink
-  int statval = 0;
   struct stat info;
-  do {
-    statval = lstat(possiblefile.c_str(), &info);
-  } while (statval < 0 && errno == EINTR);
-
-  if (statval < 0) {
+  if (statat(AT_FDCWD, possiblefile.c_str(), info, AT_SYMLINK_NOFOLLOW) < 0) {
     // probably file does not exist, or trouble with rights.
-    RDDEBUG("got negative statval " << statval << std::endl);
-    //(*m_report_failed_on_stat)(path, filename, recursionlevel);
-    return -1;
-  } else {
-    RDDEBUG("got positive statval " << statval << std::endl);
+    RDDEBUG("got negative statval" << std::endl);
+    return;
   }
 
   if (S_ISLNK(info.st_mode)) {
     RDDEBUG("found symlink" << std::endl);
-    if (m_followsymlinks) {
-      m_callback(path, filename, recursionlevel);
+    if (!m_followsymlinks ||
+        statat(AT_FDCWD, possiblefile.c_str(), info, 0) < 0) {
+      return;
     }
-    return 0;
-  } else {
-    RDDEBUG("not a symlink" << std::endl);
   }
 
   if (S_ISDIR(info.st_mode)) {
@@ -161,24 +323,24 @@ Dirlist::handlepossiblefile(const std::string& possiblefile, int recursionlevel)
                  "FIXME! details on the next row:\n";
     std::cerr << "possiblefile=\"" << possiblefile << "\"\n";
     // this should never happen, because this function is only to be called
-    // for items that can not be opened with opendir.
+    // for items that can not be opened as directories.
     // maybe it happens if someone else is changing the file while we
     // are reading it?
-    return -2;
-  } else {
-    RDDEBUG("not a dir\n");
+    return;
   }
 
   if (S_ISREG(info.st_mode)) {
     RDDEBUG("it is a regular file" << std::endl);
-    m_callback(path, filename, recursionlevel);
-    return 0;
-  } else {
-    RDDEBUG("not a regular file" << std::endl);
+    // split filename into path and filename
+    std::string path, filename;
+    splitfilename(path, filename, possiblefile);
+    std::vector<DirlistEntry> files{{filename, info}};
+    callback(rootIndex, DirlistPosition(), path, 0, files);
+    return;
   }
+
   std::cout
     << "Dirlist.cc::handlepossiblefile(): found something else than a dir or "
        "a regular file."
     << std::endl;
-  return -1;
 }
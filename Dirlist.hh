@@ -7,41 +7,98 @@
 #ifndef Dirlist_hh
 #define Dirlist_hh
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
-/// class that traverses a directory
+// os specific headers
+#include <sys/stat.h>
+
+class TaskGroup;
+class ThreadPool;
+
+/// a regular file found by Dirlist, with the stat info it was classified by
+struct DirlistEntry
+{
+  std::string name;
+  struct stat info;
+};
+
+/**
+ where a directory is in its root: for each directory on the way down to it,
+ the index among the subdirectories of its parent, which are read in the
+ same order every time. sorting on it gives the order a serial depth first
+ walk visits the directories in, whichever thread got to them first.
+ */
+using DirlistPosition = std::vector<std::uint32_t>;
+
+/**
+ called once per directory with the regular files in it (and symlinks to
+ regular files, if followed). rootIndex is the position of the root in the
+ list given to walk, depth is 0 for files directly in a root.
+ It is called from several threads at once, in no particular order.
+ */
+using DirlistCallback = std::function<void(std::size_t rootIndex,
+                                           const DirlistPosition& position,
+                                           const std::string& dir,
+                                           int depth,
+                                           std::vector<DirlistEntry>& files)>;
+
+/**
+ class that traverses directories.
+ Every directory is read as a task on the thread pool, so subtrees and the
+ roots are walked in parallel. The entries of a directory are read in one go
+ (getdents64 on linux), stat:ed relative to the directory in inode order, and
+ the stat is skipped for subdirectories when the file system reports the type.
+ The stats of a directory are issued as one batch, through io_uring if
+ batchedstat is set (see StatBatch).
+ */
 class Dirlist
 {
 public:
   // constructor
-  explicit Dirlist(bool followsymlinks)
+  Dirlist(bool followsymlinks, bool batchedstat, ThreadPool& pool)
     : m_followsymlinks(followsymlinks)
-    , m_callback(nullptr)
+    , m_batchedstat(batchedstat)
+    , m_pool(pool)
   {}
 
+  // find all files below the roots, which may also be files themselves
+  void walk(const std::vector<std::string>& roots, const DirlistCallback& callback);
+
+  // directories read and stats issued by the walks so far
+  std::uint64_t directoryCount() const { return m_directorycount; }
+  std::uint64_t statCount() const { return m_statcount; }
+  // the time spent in the stats, summed over the threads
+  double statSeconds() const { return static_cast<double>(m_statnanoseconds) / 1e9; }
+
 private:
   // follow symlinks or not
   bool m_followsymlinks;
 
-  // where to report found files. this is called for every item in all
-  // directories found by walk.
-  //typedef int (*reportfcntype)(const std::string&, const std::string&, int);
+  // stat through io_uring, where the kernel has it
+  bool m_batchedstat;
 
-  // called when a regular file or a symlink is encountered
-  //reportfcntype m_callback;
-  std::function<int(const std::string&, const std::string&, int)> m_callback;
+  ThreadPool& m_pool;
+  std::atomic<std::uint64_t> m_directorycount{ 0 };
+  std::atomic<std::uint64_t> m_statcount{ 0 };
+  std::atomic<std::uint64_t> m_statnanoseconds{ 0 };
 
-  // a function that is called from walk when a non-directory is encountered
-  // for instance,if walk("/path/to/a/file.ext") is called instead of
-  // walk("/path/to/a/")
-  int handlepossiblefile(const std::string& possiblefile, int recursionlevel);
-
-public:
-  // find all files on a specific place
-  int walk(const std::string& dir, const int recursionlevel = 0);
+  // reads the directory open as fd (and closes it), queues its subdirectories
+  void walkdirectory(TaskGroup& group,
+                     const DirlistCallback& callback,
+                     std::size_t rootIndex,
+                     const DirlistPosition& position,
+                     int fd,
+                     const std::string& dir,
+                     int recursionlevel);
 
-  // to set the report functions
-  void setcallbackfcn(std::function<int(const std::string&, const std::string&, int)> reportfcn) { m_callback = reportfcn; }
+  // a root which can not be opened as a directory
+  void handlepossiblefile(const DirlistCallback& callback,
+                          std::size_t rootIndex,
+                          const std::string& possiblefile);
 };
 
 #endif
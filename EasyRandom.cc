@@ -18,6 +18,20 @@ class EasyRandom::GlobalRandom final
 {
 public:
   char randomFileChar() { return getChar(m_dist(m_gen)); }
+  int uniformInt(int low, int high)
+  {
+    return std::uniform_int_distribution<int>{ low, high }(m_gen);
+  }
+  double uniformReal(double low, double high)
+  {
+    return std::uniform_real_distribution<double>{ low, high }(m_gen);
+  }
+  explicit GlobalRandom(std::uint64_t seed)
+  {
+    std::seed_seq seq{ static_cast<std::uint32_t>(seed),
+                       static_cast<std::uint32_t>(seed >> 32) };
+    m_gen.seed(seq);
+  }
   GlobalRandom()
   {
     // there are pitfalls of random device - may be nondeterministic. for that,
@@ -64,6 +78,13 @@ EasyRandom::EasyRandom()
   : m_rand(getGlobalObject())
 {}
 
+EasyRandom::EasyRandom(std::uint64_t seed)
+  : m_own(new GlobalRandom(seed))
+  , m_rand(*m_own)
+{}
+
+EasyRandom::~EasyRandom() = default;
+
 std::string
 EasyRandom::makeRandomFileString(std::size_t N)
 {
@@ -73,3 +94,15 @@ EasyRandom::makeRandomFileString(std::size_t N)
   }
   return ret;
 }
+
+int
+EasyRandom::uniformInt(int low, int high)
+{
+  return m_rand.uniformInt(low, high);
+}
+
+double
+EasyRandom::uniformReal(double low, double high)
+{
+  return m_rand.uniformReal(low, high);
+}
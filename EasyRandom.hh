@@ -6,18 +6,30 @@
 #ifndef RDFIND_EASYRANDOM_HH_
 #define RDFIND_EASYRANDOM_HH_
 
+#include <cstdint>
+#include <memory>
 #include <string>
 
 /**
  * Helper object to "provide a replacement of std::rand()"
  * It is automatically seeded.
- * The state is global, and not held in the class
+ * The state is global, and not held in the class, unless a seed is given.
+ * Then the object has a generator of its own and gives the same sequence
+ * on every run, for generating test data.
  * This class is not thread safe.
  */
 class EasyRandom final
 {
 public:
   EasyRandom();
+  /**
+   * a generator of its own, seeded with seed instead of from the system.
+   * @param seed
+   */
+  explicit EasyRandom(std::uint64_t seed);
+  ~EasyRandom();
+  EasyRandom(const EasyRandom&) = delete;
+  EasyRandom& operator=(const EasyRandom&) = delete;
   /**
    * makes N random characters, suitable to use for a random filename.
    * @param N
@@ -25,8 +37,20 @@ public:
    */
   std::string makeRandomFileString(std::size_t N = 16);
 
+  /**
+   * a uniformly distributed integer in [low, high]
+   */
+  int uniformInt(int low, int high);
+
+  /**
+   * a uniformly distributed number in [low, high)
+   */
+  double uniformReal(double low, double high);
+
 private:
   class GlobalRandom;
+  // the generator of a seeded object, null for the global one
+  std::unique_ptr<GlobalRandom> m_own;
   // keep a reference to the global magic static, to avoid the cost of thread
   // safe initialization.
   GlobalRandom& m_rand;
@@ -0,0 +1,322 @@
+//
+//  FileTable.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "config.h"
+
+#include "FileTable.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <opencv2/img_hash.hpp>
+
+#include "ImageReader.hh"
+
+using namespace cv::img_hash;
+
+FileTable::FileTable(Cache* cache)
+  : cache(cache)
+  , chunks(new unique_ptr<Chunk>[maxChunks])
+  , dirChunks(new unique_ptr<DirChunk>[maxChunks])
+{
+  dirChunks[0].reset(new DirChunk);
+  dirChunks[0]->parent[rootDirectory] = rootDirectory;
+  dirChunks[0]->name[rootDirectory] = "";
+  dirCount = 1;
+}
+
+FileTable::DirId FileTable::addDirectory(const string& path) {
+  if (path.empty()) {
+    return rootDirectory;
+  }
+
+  lock_guard<mutex> lock(addMutex);
+  // one node per component between slashes. an absolute path starts with
+  // an empty one, so joining the names with slashes gives path back.
+  DirId dir = rootDirectory;
+  string_view rest(path);
+  for (;;) {
+    const auto slash = rest.find('/');
+    const auto name = rest.substr(0, slash);
+
+    auto found = dirIds.find(DirKey{dir, name});
+    if (found != dirIds.end()) {
+      dir = found->second;
+    } else {
+      if (dirCount == maxDirectories) {
+        throw runtime_error("too many directories");
+      }
+      const auto child = static_cast<DirId>(dirCount++);
+      auto& chunk = dirChunks[child >> chunkBits];
+      if (!chunk) {
+        chunk.reset(new DirChunk);
+      }
+      const char* stored = storeName(name);
+      chunk->parent[slot(child)] = dir;
+      chunk->name[slot(child)] = stored;
+      dirIds.emplace(DirKey{dir, string_view(stored, name.size())}, child);
+      dir = child;
+    }
+
+    rest.remove_prefix(slash == string_view::npos ? rest.size() : slash + 1);
+    // a trailing slash, as in "/", names no further directory
+    if (rest.empty()) {
+      return dir;
+    }
+  }
+}
+
+FileTable::Id FileTable::add(DirId dir, const string& name, int cmdlineIndex, int depth, const struct stat& info) {
+  lock_guard<mutex> lock(addMutex);
+  if (rowCount == chunkRows * maxChunks) {
+    throw runtime_error("too many files");
+  }
+
+  const auto id = static_cast<Id>(rowCount);
+  auto& chunk = chunks[id >> chunkBits];
+  if (!chunk) {
+    chunk.reset(new Chunk);
+  }
+
+  const auto i = slot(id);
+  chunk->size[i] = info.st_size;
+  chunk->inode[i] = info.st_ino;
+  chunk->device[i] = info.st_dev;
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+  chunk->mtimeNs[i] = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC)
+  chunk->mtimeNs[i] = int64_t(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+  chunk->mtimeNs[i] = int64_t(info.st_mtime) * 1000000000;
+#endif
+  chunk->identity[i] = 0;
+  chunk->aHash[i] = 0;
+  chunk->pHash[i] = 0;
+  chunk->name[i] = storeName(name);
+  chunk->dir[i] = dir;
+  chunk->cmdlineIndex[i] = cmdlineIndex;
+  chunk->depth[i] = depth;
+  chunk->flags[i] = 0;
+
+  ++rowCount;
+  return id;
+}
+
+size_t FileTable::size() const {
+  lock_guard<mutex> lock(addMutex);
+  return rowCount;
+}
+
+const char* FileTable::storeName(string_view name) {
+  const auto needed = name.size() + 1;
+  if (needed > nameFreeSize) {
+    // a name longer than a block gets a block of its own
+    const auto blockSize = max(needed, nameBlockSize);
+    nameBlocks.emplace_back(new char[blockSize]);
+    nameFree = nameBlocks.back().get();
+    nameFreeSize = blockSize;
+  }
+
+  char* stored = nameFree;
+  memcpy(stored, name.data(), name.size());
+  stored[name.size()] = '\0';
+  nameFree += needed;
+  nameFreeSize -= needed;
+  return stored;
+}
+
+void FileTable::appendDirectory(DirId dir, string& buffer) const {
+  if (dir == rootDirectory) {
+    return;
+  }
+
+  const auto parent = dirRow(dir).parent[slot(dir)];
+  appendDirectory(parent, buffer);
+  if (parent != rootDirectory) {
+    buffer += '/';
+  }
+  buffer += dirRow(dir).name[slot(dir)];
+}
+
+const string& FileTable::directoryPath(DirId dir, string& buffer) const {
+  buffer.clear();
+  appendDirectory(dir, buffer);
+  return buffer;
+}
+
+const string& FileTable::path(Id id, string& buffer) const {
+  const auto dir = directory(id);
+  directoryPath(dir, buffer);
+  if (dir != rootDirectory) {
+    buffer += '/';
+  }
+  buffer += baseName(id);
+  return buffer;
+}
+
+FileStamp FileTable::stamp(Id id) const {
+  const auto& chunk = row(id);
+  const auto i = slot(id);
+  FileStamp result;
+  result.size = chunk.size[i];
+  result.inode = chunk.inode[i];
+  result.device = chunk.device[i];
+  result.mtimeNs = chunk.mtimeNs[i];
+  return result;
+}
+
+bool FileTable::isImage(Id id) const {
+  return hasImageExtension(baseName(id));
+}
+
+void FileTable::setHashes(Id id, const ImageHash& a, const ImageHash& p) {
+  row(id).aHash[slot(id)] = a.word(0);
+  row(id).pHash[slot(id)] = p.word(0);
+}
+
+bool FileTable::loadCachedHashes(Id id, const string& path) {
+  const auto fileStamp = stamp(id);
+  CacheEntry entry;
+  if (!cache->get(path, fileStamp, entry)) {
+    return true;
+  }
+
+  if (entry.isInvalidImage) {
+    setInvalidImage(id);
+    return false;
+  }
+
+  if (!entry.hasAverageHash || !entry.hasPHash) {
+    return true;
+  }
+
+  setHashes(id, entry.averageHash, entry.pHash);
+  if (!entry.hasStamp) {
+    // trusted from an older cache, remember the stamp from now on
+    entry.stamp = fileStamp;
+    entry.hasStamp = true;
+    cache->put(path, entry);
+  }
+  return false;
+}
+
+void FileTable::calcHashes(Id id, const string& path, const Mat& img) {
+  CacheEntry entry;
+  entry.stamp = stamp(id);
+  entry.hasStamp = true;
+
+  if (img.empty()) {
+    setInvalidImage(id);
+    entry.isInvalidImage = true;
+    cache->put(path, entry);
+    return;
+  }
+
+  // one grayscale decode, reduced by the jpeg decoder where the image is
+  // large, serves both hashes. they convert to gray and shrink to 8x8 and
+  // 32x32 anyway.
+  Mat hash;
+  AverageHash::create()->compute(img, hash);
+  entry.averageHash = ImageHash::fromMat(hash);
+  PHash::create()->compute(img, hash);
+  entry.pHash = ImageHash::fromMat(hash);
+  setHashes(id, entry.averageHash, entry.pHash);
+
+  entry.hasAverageHash = true;
+  entry.hasPHash = true;
+  cache->put(path, entry);
+}
+
+void FileTable::calcHashes(Id id, MemoryBudget& budget) {
+  string buffer;
+  const auto& name = path(id, buffer);
+  if (loadCachedHashes(id, name)) {
+    MemoryBudget::Reservation reservation;
+    DecodeAdmission admission;
+    const auto img = readImageForHashing(name, budget, reservation, admission);
+    if (admission == DecodeAdmission::skipped) {
+      skipHashes(id);
+    } else {
+      calcHashes(id, name, img);
+    }
+  }
+}
+
+void FileTable::copyHashes(Id id, const string& path, Id identical) {
+  if (isSkippedImage(identical)) {
+    skipHashes(id);
+    return;
+  }
+
+  CacheEntry entry;
+  entry.stamp = stamp(id);
+  entry.hasStamp = true;
+
+  if (isInvalidImage(identical)) {
+    setInvalidImage(id);
+    entry.isInvalidImage = true;
+  } else {
+    entry.averageHash.setWord(0, aHash(identical));
+    entry.pHash.setWord(0, pHash(identical));
+    setHashes(id, entry.averageHash, entry.pHash);
+    entry.hasAverageHash = true;
+    entry.hasPHash = true;
+  }
+  cache->put(path, entry);
+}
+
+void FileTable::skipHashes(Id id) {
+  row(id).flags[slot(id)] |= invalidImageFlag | skippedImageFlag;
+}
+
+FileTable::PathOrder::PathOrder(const FileTable& table)
+  : table(table)
+{
+  lock_guard<mutex> lock(table.addMutex);
+  // a parent is interned before its children, so has its prefix already
+  prefixes.resize(table.dirCount);
+  for (DirId dir = 1; dir < table.dirCount; ++dir) {
+    const auto& node = table.dirRow(dir);
+    prefixes[dir] = prefixes[node.parent[slot(dir)]];
+    prefixes[dir] += node.name[slot(dir)];
+    prefixes[dir] += '/';
+  }
+}
+
+int FileTable::PathOrder::compare(Id a, Id b) const {
+  // each path is its directory prefix followed by its basename, compared
+  // piece by piece as one string
+  string_view a1 = prefixes[table.directory(a)];
+  string_view a2 = table.baseName(a);
+  string_view b1 = prefixes[table.directory(b)];
+  string_view b2 = table.baseName(b);
+  for (;;) {
+    if (a1.empty()) {
+      if (a2.empty()) {
+        return b1.empty() && b2.empty() ? 0 : -1;
+      }
+      a1 = a2;
+      a2 = string_view();
+    }
+    if (b1.empty()) {
+      if (b2.empty()) {
+        return 1;
+      }
+      b1 = b2;
+      b2 = string_view();
+    }
+
+    const auto n = min(a1.size(), b1.size());
+    const int c = a1.compare(0, n, b1.substr(0, n));
+    if (c != 0) {
+      return c;
+    }
+    a1.remove_prefix(n);
+    b1.remove_prefix(n);
+  }
+}
@@ -0,0 +1,230 @@
+//
+//  FileTable.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef FileTable_hpp
+#define FileTable_hpp
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// os specific headers
+#include <sys/stat.h>
+#include <sys/types.h> //for off_t and others.
+
+#include <opencv2/opencv.hpp>
+#include "Cache.hh"
+#include "ImageHash.hh"
+#include "MemoryBudget.hh"
+
+using namespace std;
+using namespace cv;
+
+/**
+ Holds information about all files found, one row per file and one array per
+ column. The stages which look at every file read only the columns they need,
+ from contiguous memory: a sort on device and inode does not pull names and
+ hashes into the cache, and the clustering scans hashes only.
+ Rows are added in chunks which never move, so files can be added while
+ others are being hashed.
+ Paths are not stored whole. Each directory is interned once, as a node with
+ its parent and its own name, and a file keeps its directory and basename.
+ Names live in blocks of an arena, a file costs its columns plus its
+ basename and no allocation of its own. Full paths are put together on
+ demand, into a buffer the caller reuses.
+ */
+class FileTable {
+public:
+  // index of a row, files are referred to by it
+  using Id = uint32_t;
+  // index of an interned directory
+  using DirId = uint32_t;
+  // the empty path, files directly in it are named by their basename
+  static constexpr DirId rootDirectory = 0;
+
+  /// for storing file size in bytes, defined in sys/types.h
+  using filesizetype = off_t;
+
+  explicit FileTable(Cache* cache);
+  FileTable(const FileTable&) = delete;
+  FileTable& operator=(const FileTable&) = delete;
+
+  /**
+   * interns the directory path, and the directories leading to it. a path
+   * interned before gives the same id. may be called from several threads.
+   */
+  DirId addDirectory(const string& path);
+
+  /**
+   * adds the file name in directory dir, found at depth below command line
+   * argument cmdlineIndex. only the size, inode, device and modification
+   * time of info are kept. may be called from several threads at once, and
+   * while other rows are used.
+   */
+  Id add(DirId dir, const string& name, int cmdlineIndex, int depth, const struct stat& info);
+
+  // number of rows
+  size_t size() const;
+
+  // gets the filename without its directory
+  const char* baseName(Id id) const { return row(id).name[slot(id)]; }
+
+  // gets the directory the file is in
+  DirId directory(Id id) const { return row(id).dir[slot(id)]; }
+
+  // puts the filename, including path, into buffer and returns it
+  const string& path(Id id, string& buffer) const;
+
+  // puts the path of directory dir into buffer and returns it
+  const string& directoryPath(DirId dir, string& buffer) const;
+
+  /// returns the file size in bytes
+  filesizetype fileSize(Id id) const { return row(id).size[slot(id)]; }
+
+  // returns the inode number
+  uint64_t inode(Id id) const { return row(id).inode[slot(id)]; }
+
+  // returns the device
+  uint64_t device(Id id) const { return row(id).device[slot(id)]; }
+
+  // gets the command line index the file was found at
+  int cmdlineIndex(Id id) const { return row(id).cmdlineIndex[slot(id)]; }
+
+  // gets the depth
+  int depth(Id id) const { return row(id).depth[slot(id)]; }
+
+  // a number to identify the file, used for ranking
+  int64_t identity(Id id) const { return row(id).identity[slot(id)]; }
+  void setIdentity(Id id, int64_t identity) { row(id).identity[slot(id)] = identity; }
+
+  bool isInvalidImage(Id id) const { return row(id).flags[slot(id)] & invalidImageFlag; }
+  void setInvalidImage(Id id) { row(id).flags[slot(id)] |= invalidImageFlag; }
+  // an image too large for the decode budget, left out like an invalid one
+  bool isSkippedImage(Id id) const { return row(id).flags[slot(id)] & skippedImageFlag; }
+
+  uint64_t aHash(Id id) const { return row(id).aHash[slot(id)]; }
+  uint64_t pHash(Id id) const { return row(id).pHash[slot(id)]; }
+
+  // size, inode, device and modification time, to validate cached hashes
+  FileStamp stamp(Id id) const;
+
+  // true if the name has the extension of an image format we hash
+  bool isImage(Id id) const;
+  /**
+   * takes the hashes from the cache, if it has valid ones for the file.
+   * path is the file's path, as given by path().
+   * @return true if the image has to be decoded to get them
+   */
+  bool loadCachedHashes(Id id, const string& path);
+  // computes both hashes from the decoded image, an empty one marks the file
+  // as an invalid image. the result is stored in the cache.
+  void calcHashes(Id id, const string& path, const Mat& img);
+  // loadCachedHashes, decoding the file within budget if that was not enough
+  void calcHashes(Id id, MemoryBudget& budget);
+  // takes the hashes of a file with the same content, and caches them
+  void copyHashes(Id id, const string& path, Id identical);
+  // leaves out an image which was not decoded for lack of memory. nothing
+  // is cached, so a run with a larger budget hashes it.
+  void skipHashes(Id id);
+
+  /**
+   * orders files on their full path, as a comparison of the path strings
+   * would, without putting the paths together. each directory path is put
+   * together once, when the order is made, so make it after the walk.
+   */
+  class PathOrder {
+  public:
+    explicit PathOrder(const FileTable& table);
+    bool operator()(Id a, Id b) const { return compare(a, b) < 0; }
+    int compare(Id a, Id b) const;
+
+  private:
+    const FileTable& table;
+    // the path of each directory followed by a slash, empty for the root
+    vector<string> prefixes;
+  };
+
+private:
+  static_assert(ImageHash::wordCount == 1, "the hash columns hold one word");
+
+  static constexpr size_t chunkBits = 16;
+  static constexpr size_t chunkRows = size_t(1) << chunkBits;
+  static constexpr size_t maxChunks = size_t(1) << (32 - chunkBits);
+  static constexpr size_t nameBlockSize = size_t(1) << 20;
+
+  static constexpr uint8_t invalidImageFlag = 1;
+  static constexpr uint8_t skippedImageFlag = 2;
+  static constexpr size_t maxDirectories = chunkRows * maxChunks;
+
+  // the columns of chunkRows rows. left uninitialized, so memory is only
+  // touched for the rows added.
+  struct Chunk {
+    filesizetype size[chunkRows];
+    uint64_t inode[chunkRows];
+    uint64_t device[chunkRows];
+    int64_t mtimeNs[chunkRows];
+    int64_t identity[chunkRows];
+    uint64_t aHash[chunkRows];
+    uint64_t pHash[chunkRows];
+    // the basename
+    const char* name[chunkRows];
+    DirId dir[chunkRows];
+    int32_t cmdlineIndex[chunkRows];
+    int32_t depth[chunkRows];
+    uint8_t flags[chunkRows];
+  };
+
+  // the directory nodes, chunked like the rows
+  struct DirChunk {
+    DirId parent[chunkRows];
+    const char* name[chunkRows];
+  };
+
+  // a directory is found by its parent and name when interning
+  struct DirKey {
+    DirId parent;
+    string_view name;
+
+    bool operator==(const DirKey& other) const {
+      return parent == other.parent && name == other.name;
+    }
+  };
+
+  struct DirKeyHash {
+    size_t operator()(const DirKey& key) const {
+      return hash<string_view>()(key.name) ^ (size_t(key.parent) * 0x9e3779b97f4a7c15ULL);
+    }
+  };
+
+  Chunk& row(Id id) const { return *chunks[id >> chunkBits]; }
+  DirChunk& dirRow(DirId dir) const { return *dirChunks[dir >> chunkBits]; }
+  static size_t slot(Id id) { return id & (chunkRows - 1); }
+  void setHashes(Id id, const ImageHash& a, const ImageHash& p);
+  void appendDirectory(DirId dir, string& buffer) const;
+  // copies name to the arena, under addMutex
+  const char* storeName(string_view name);
+
+  Cache* cache;
+  // a fixed table of chunk pointers, so looking a row up never races with a
+  // chunk being added
+  unique_ptr<unique_ptr<Chunk>[]> chunks;
+  unique_ptr<unique_ptr<DirChunk>[]> dirChunks;
+  // guards adding rows, directories, names and chunks
+  mutable mutex addMutex;
+  size_t rowCount = 0;
+  size_t dirCount = 0;
+  unordered_map<DirKey, DirId, DirKeyHash> dirIds;
+  vector<unique_ptr<char[]>> nameBlocks;
+  char* nameFree = nullptr;
+  size_t nameFreeSize = 0;
+};
+
+#endif /* FileTable_hpp */
@@ -0,0 +1,205 @@
+//
+//  HammingDistance.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "HammingDistance.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RDFIND_HAMMING_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+struct HammingKernel {
+  const char* name;
+  bool (*isSupported)();
+  int (*maxDistance)(uint64_t, const uint64_t*, size_t, int);
+  void (*distances)(uint64_t, const uint64_t*, size_t, uint8_t*);
+};
+
+bool alwaysSupported() {
+  return true;
+}
+
+int maxDistanceScalar(uint64_t query, const uint64_t* hashes, size_t count, int limit) {
+  int result = 0;
+  for (size_t i = 0; i < count && result <= limit; ++i) {
+    result = max(result, __builtin_popcountll(query ^ hashes[i]));
+  }
+
+  return result;
+}
+
+void distancesScalar(uint64_t query, const uint64_t* hashes, size_t count, uint8_t* outDistances) {
+  for (size_t i = 0; i < count; ++i) {
+    outDistances[i] = static_cast<uint8_t>(__builtin_popcountll(query ^ hashes[i]));
+  }
+}
+
+#ifdef RDFIND_HAMMING_X86
+
+bool avx2Supported() {
+  return __builtin_cpu_supports("avx2");
+}
+
+// per 64 bit lane popcount: nibble lookup with pshufb, summed by psadbw
+__attribute__((target("avx2")))
+inline __m256i popcountAvx2(__m256i v) {
+  const __m256i lookup = _mm256_setr_epi8(
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowMask = _mm256_set1_epi8(0x0f);
+  const __m256i lo = _mm256_and_si256(v, lowMask);
+  const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+  const __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+  return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+int maxDistanceAvx2(uint64_t query, const uint64_t* hashes, size_t count, int limit) {
+  const __m256i q = _mm256_set1_epi64x(static_cast<long long>(query));
+  const __m256i l = _mm256_set1_epi32(limit);
+  __m256i m = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m256i x = _mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hashes + i)));
+    // counts fit in the low 32 bits of each lane, the high halves stay zero
+    m = _mm256_max_epi32(m, popcountAvx2(x));
+    if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(m, l))) {
+      break;
+    }
+  }
+
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), m);
+  int result = static_cast<int>(*max_element(lanes, lanes + 4));
+  if (result > limit) {
+    return result;
+  }
+
+  return max(result, maxDistanceScalar(query, hashes + i, count - i, limit));
+}
+
+__attribute__((target("avx2")))
+void distancesAvx2(uint64_t query, const uint64_t* hashes, size_t count, uint8_t* outDistances) {
+  const __m256i q = _mm256_set1_epi64x(static_cast<long long>(query));
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m256i x = _mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hashes + i)));
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), popcountAvx2(x));
+    for (size_t j = 0; j < 4; ++j) {
+      outDistances[i + j] = static_cast<uint8_t>(lanes[j]);
+    }
+  }
+
+  distancesScalar(query, hashes + i, count - i, outDistances + i);
+}
+
+bool avx512Supported() {
+  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq");
+}
+
+// once inlined, gcc 12 reports the undefined vectors these intrinsics start
+// from as uninitialized
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+int maxDistanceAvx512(uint64_t query, const uint64_t* hashes, size_t count, int limit) {
+  const __m512i q = _mm512_set1_epi64(static_cast<long long>(query));
+  const __m512i l = _mm512_set1_epi64(limit);
+  __m512i m = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m512i x = _mm512_xor_si512(q, _mm512_loadu_si512(hashes + i));
+    m = _mm512_max_epu64(m, _mm512_popcnt_epi64(x));
+    if (_mm512_cmpgt_epu64_mask(m, l)) {
+      break;
+    }
+  }
+
+  int result = static_cast<int>(_mm512_reduce_max_epu64(m));
+  if (result > limit) {
+    return result;
+  }
+
+  return max(result, maxDistanceScalar(query, hashes + i, count - i, limit));
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+void distancesAvx512(uint64_t query, const uint64_t* hashes, size_t count, uint8_t* outDistances) {
+  const __m512i q = _mm512_set1_epi64(static_cast<long long>(query));
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m512i x = _mm512_xor_si512(q, _mm512_loadu_si512(hashes + i));
+    // narrow the eight 64 bit counts to bytes
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(outDistances + i), _mm512_cvtepi64_epi8(_mm512_popcnt_epi64(x)));
+  }
+
+  distancesScalar(query, hashes + i, count - i, outDistances + i);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // RDFIND_HAMMING_X86
+
+// best first
+const HammingKernel kernels[] = {
+#ifdef RDFIND_HAMMING_X86
+  {"avx512", &avx512Supported, &maxDistanceAvx512, &distancesAvx512},
+  {"avx2", &avx2Supported, &maxDistanceAvx2, &distancesAvx2},
+#endif
+  {"scalar", &alwaysSupported, &maxDistanceScalar, &distancesScalar},
+};
+
+const HammingKernel* detectKernel() {
+  for (auto& k : kernels) {
+    if (k.isSupported()) {
+      return &k;
+    }
+  }
+
+  return &kernels[0];
+}
+
+const HammingKernel* activeKernel = detectKernel();
+
+} // namespace
+
+int hammingMaxDistance(uint64_t query, const uint64_t* hashes, size_t count, int limit) {
+  return activeKernel->maxDistance(query, hashes, count, limit);
+}
+
+void hammingDistances(uint64_t query, const uint64_t* hashes, size_t count, uint8_t* outDistances) {
+  activeKernel->distances(query, hashes, count, outDistances);
+}
+
+const char* hammingKernelName() {
+  return activeKernel->name;
+}
+
+bool selectHammingKernel(const char* name) {
+  for (auto& k : kernels) {
+    if (strcmp(k.name, name) == 0 && k.isSupported()) {
+      activeKernel = &k;
+      return true;
+    }
+  }
+
+  return false;
+}
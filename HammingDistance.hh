@@ -0,0 +1,39 @@
+//
+//  HammingDistance.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef HammingDistance_hpp
+#define HammingDistance_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ One to many hamming distance kernels over 64 bit hashes.
+ The implementation is picked at startup from what the cpu supports:
+ AVX-512 VPOPCNTQ, AVX2 or plain popcount.
+ */
+
+/**
+ * returns the largest distance between query and hashes[0..count).
+ * stops as soon as a distance larger than limit is seen, the result is then
+ * some value larger than limit.
+ */
+int hammingMaxDistance(uint64_t query, const uint64_t* hashes, size_t count, int limit);
+
+// writes the distance between query and hashes[i] to outDistances[i]
+void hammingDistances(uint64_t query, const uint64_t* hashes, size_t count, uint8_t* outDistances);
+
+// name of the active kernel: "avx512", "avx2" or "scalar"
+const char* hammingKernelName();
+
+/**
+ * switches the active kernel, for benchmarks. not thread safe.
+ * @return false if the kernel is unknown or not supported by this cpu
+ */
+bool selectHammingKernel(const char* name);
+
+#endif /* HammingDistance_hpp */
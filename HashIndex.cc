@@ -0,0 +1,50 @@
+//
+//  HashIndex.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "HashIndex.hh"
+
+#include <algorithm>
+
+HashIndex::HashIndex(int maxDistance) {
+  const int blockCount = max(1, min(maxDistance + 1, 64));
+  for (int i = 0; i < blockCount; ++i) {
+    const int begin = i * 64 / blockCount;
+    const int end = (i + 1) * 64 / blockCount;
+    const int width = end - begin;
+    const uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    blocks.push_back({begin, mask, {}});
+  }
+}
+
+void HashIndex::insert(uint64_t hash, uint32_t id) {
+  for (auto& b : blocks) {
+    auto& ids = b.ids[(hash >> b.shift) & b.mask];
+    // members of one cluster often share blocks, skip the repeated id
+    if (ids.empty() || ids.back() != id) {
+      ids.push_back(id);
+    }
+  }
+}
+
+void HashIndex::find(uint64_t hash, vector<uint32_t>& outIds) const {
+  outIds.clear();
+  for (auto& b : blocks) {
+    auto it = b.ids.find((hash >> b.shift) & b.mask);
+    if (it != b.ids.end()) {
+      outIds.insert(outIds.end(), it->second.begin(), it->second.end());
+    }
+  }
+
+  sort(outIds.begin(), outIds.end());
+  outIds.erase(unique(outIds.begin(), outIds.end()), outIds.end());
+}
+
+void HashIndex::clear() {
+  for (auto& b : blocks) {
+    b.ids.clear();
+  }
+}
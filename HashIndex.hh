@@ -0,0 +1,46 @@
+//
+//  HashIndex.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef HashIndex_hpp
+#define HashIndex_hpp
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ Multi-index hashing over 64 bit hashes.
+ The hash is split into maxDistance + 1 disjoint bit blocks. Two hashes within
+ hamming distance maxDistance can differ in at most maxDistance blocks, so they
+ must be equal on at least one of them. Looking up every block of a query
+ returns a superset of all the ids stored with a hash within maxDistance.
+ */
+class HashIndex {
+public:
+  explicit HashIndex(int maxDistance);
+
+  // stores id under every block of hash
+  void insert(uint64_t hash, uint32_t id);
+
+  // collects ids sharing at least one block with hash, sorted and without duplicates
+  void find(uint64_t hash, vector<uint32_t>& outIds) const;
+
+  void clear();
+
+private:
+  struct Block {
+    int shift;
+    uint64_t mask;
+    unordered_map<uint64_t, vector<uint32_t>> ids;
+  };
+
+  vector<Block> blocks;
+};
+
+#endif /* HashIndex_hpp */
@@ -0,0 +1,529 @@
+//
+//  HashPipeline.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "config.h"
+
+#include "HashPipeline.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Checksum.hh"
+#include "ImageReader.hh"
+#include "IoRing.hh"
+#include "ThreadPool.hh"
+
+namespace {
+
+// larger buffers are freed instead of kept in the pool
+const size_t maxPooledBufferSize = size_t(16) << 20;
+// the bytes at each end of a file which go into its content key
+const size_t contentBlockSize = 4096;
+
+// the cpu time of the calling thread so far
+uint64_t threadCpuNs() {
+  struct timespec now;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+}
+
+// the counter has one writer, so a plain store does. relaxed, as readers
+// of the counts only need each to be up to date on its own.
+void bump(atomic<uint64_t>& counter, uint64_t amount = 1) {
+  counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// true if the file at path holds exactly data
+bool fileEquals(const string& path, const FileBuffer& data) {
+  int fd;
+  do {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    return false;
+  }
+  unsigned char chunk[64 * 1024];
+  size_t done = 0;
+  bool equal = true;
+  while (equal) {
+    const ssize_t res = read(fd, chunk, sizeof(chunk));
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      equal = res == 0 && done == data.size();
+      break;
+    }
+    const auto size = static_cast<size_t>(res);
+    equal = size <= data.size() - done && memcmp(chunk, data.data() + done, size) == 0;
+    done += size;
+  }
+  close(fd);
+  return equal;
+}
+
+} // namespace
+
+thread_local HashPipeline::ThreadCounters* HashPipeline::localCounters = nullptr;
+
+HashPipeline::HashPipeline(FileTable& table, size_t readerCount, size_t hasherCount, unsigned ioDepth,
+                           MemoryBudget& decodeBudget)
+  : table(table)
+  , decodeBudget(decodeBudget)
+  , readQueue(1024)
+  , hashQueue(max<size_t>(2 * (hasherCount ? hasherCount : ThreadPool::defaultThreadCount()), 4))
+  , activeReaders(readerCount ? readerCount : defaultReaderCount)
+{
+  if (hasherCount == 0) {
+    hasherCount = ThreadPool::defaultThreadCount();
+  }
+
+#ifdef RDFIND_IO_URING
+  if (ioDepth > 0) {
+    ringReaders.resize(activeReaders.load());
+    for (auto& reader : ringReaders) {
+      reader.ring.reset(new IoRing(ioDepth, {IORING_OP_READ}));
+      if (!reader.ring->valid()) {
+        // no io_uring, or too old for reads on it
+        ringReaders.clear();
+        break;
+      }
+      reader.reads.resize(ioDepth);
+    }
+  }
+#else
+  (void)ioDepth;
+#endif
+
+  readerCount = activeReaders.load();
+  counterCount = readerCount + hasherCount;
+  counters.reset(new ThreadCounters[counterCount]);
+
+  for (size_t i = 0; i < readerCount; ++i) {
+    readers.emplace_back([this, i]() {
+      localCounters = &counters[i];
+      if (ringReaders.empty()) {
+        readLoop();
+      } else {
+        ringReadLoop(ringReaders[i]);
+      }
+      readerCpuNs += threadCpuNs();
+      // the last reader to finish closes the hash queue
+      if (activeReaders.fetch_sub(1) == 1) {
+        hashQueue.close();
+      }
+    });
+  }
+  for (size_t i = 0; i < hasherCount; ++i) {
+    hashers.emplace_back([this, slot = readerCount + i]() {
+      localCounters = &counters[slot];
+      hashLoop();
+      hasherCpuNs += threadCpuNs();
+    });
+  }
+}
+
+HashPipeline::~HashPipeline() {
+  finish();
+}
+
+void HashPipeline::submit(FileTable::Id file) {
+  submittedFiles.fetch_add(1, memory_order_relaxed);
+  {
+    // hard links have the contents of the first, which is read once
+    lock_guard<mutex> lock(inodeMutex);
+    const auto inserted = inodes.emplace(InodeKey{table.device(file), table.inode(file)}, file);
+    if (!inserted.second) {
+      links.emplace_back(file, inserted.first->second);
+      linkedFiles.fetch_add(1, memory_order_relaxed);
+      return;
+    }
+  }
+  readQueue.push(file);
+}
+
+uint64_t HashPipeline::sum(atomic<uint64_t> ThreadCounters::*counter) const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < counterCount; ++i) {
+    total += (counters[i].*counter).load(memory_order_relaxed);
+  }
+  return total;
+}
+
+HashPipeline::Progress HashPipeline::progress() const {
+  Progress p;
+  p.submitted = submittedFiles.load(memory_order_relaxed);
+  p.cached = sum(&ThreadCounters::cached);
+  p.decoded = sum(&ThreadCounters::decoded);
+  p.bytesRead = sum(&ThreadCounters::bytesRead);
+  // every file ends up in exactly one of these, the undecodable ones are
+  // among the decoded
+  p.done = p.cached + p.decoded + sum(&ThreadCounters::failed) + sum(&ThreadCounters::identical) +
+           sum(&ThreadCounters::skipped);
+  // the hard links only get their hashes in finish, but cost nothing
+  p.done += linkedFiles.load(memory_order_relaxed);
+  return p;
+}
+
+void HashPipeline::finish() {
+  readQueue.close();
+  for (auto& t : readers) {
+    t.join();
+  }
+  for (auto& t : hashers) {
+    t.join();
+  }
+  readers.clear();
+  hashers.clear();
+
+  string path;
+  for (auto& link : links) {
+    table.copyHashes(link.first, table.path(link.first, path), link.second);
+  }
+  links.clear();
+}
+
+FileBuffer HashPipeline::takeBuffer() {
+  lock_guard<mutex> lock(bufferMutex);
+  if (freeBuffers.empty()) {
+    return FileBuffer();
+  }
+  auto buffer = move(freeBuffers.back());
+  freeBuffers.pop_back();
+  return buffer;
+}
+
+void HashPipeline::giveBuffer(FileBuffer&& buffer) {
+  // no more buffers are pooled than were in use at once
+  if (buffer.capacity() == 0 || buffer.capacity() > maxPooledBufferSize) {
+    return;
+  }
+  lock_guard<mutex> lock(bufferMutex);
+  freeBuffers.push_back(move(buffer));
+}
+
+HashPipeline::SharedBuffer HashPipeline::share(FileBuffer&& buffer) {
+  return SharedBuffer(new FileBuffer(move(buffer)), [this](const FileBuffer* shared) {
+    giveBuffer(move(*const_cast<FileBuffer*>(shared)));
+    delete shared;
+  });
+}
+
+void HashPipeline::readLoop() {
+  FileTable::Id file = 0;
+  // the path of the file, reused from file to file
+  string path;
+  while (readQueue.pop(file)) {
+    table.path(file, path);
+    if (!table.loadCachedHashes(file, path)) {
+      bump(localCounters->cached);
+      continue;
+    }
+
+    auto data = takeBuffer();
+    const bool ok = readFileContents(path, data);
+    readDone(file, path, move(data), ok);
+  }
+}
+
+#ifdef RDFIND_IO_URING
+
+void HashPipeline::ringReadLoop(RingReader& reader) {
+  IoRing& ring = *reader.ring;
+  auto& reads = reader.reads;
+  vector<size_t> freeSlots;
+  for (size_t slot = reads.size(); slot > 0; --slot) {
+    freeSlots.push_back(slot - 1);
+  }
+  vector<bool> busy(reads.size(), false);
+
+  size_t inFlight = 0;
+  bool more = true;
+  while (more || inFlight > 0) {
+    // start reads while there is room, but only wait for files to read
+    // when there is nothing in flight
+    while (more && !freeSlots.empty()) {
+      FileTable::Id file = 0;
+      if (inFlight == 0) {
+        if (!readQueue.pop(file)) {
+          more = false;
+          break;
+        }
+      } else if (!readQueue.tryPop(file)) {
+        break;
+      }
+
+      const auto slot = freeSlots.back();
+      auto& read = reads[slot];
+      read.file = file;
+      table.path(file, read.path);
+      if (!openForRead(read)) {
+        continue;
+      }
+      freeSlots.pop_back();
+      busy[slot] = true;
+      submitRead(ring, read, slot);
+      ++inFlight;
+    }
+    if (inFlight == 0) {
+      continue;
+    }
+
+    if (!ring.submit(1)) {
+      // the ring failed. the reads in flight may still write to their
+      // buffers, so they are left to it and the files are read again.
+      for (size_t slot = 0; slot < reads.size(); ++slot) {
+        if (busy[slot]) {
+          close(reads[slot].fd);
+          reads[slot].fd = -1;
+          auto data = takeBuffer();
+          const bool ok = readFileContents(reads[slot].path, data);
+          readDone(reads[slot].file, reads[slot].path, move(data), ok);
+        }
+      }
+      readLoop();
+      return;
+    }
+
+    ring.complete([&](const io_uring_cqe& cqe) {
+      const auto slot = static_cast<size_t>(cqe.user_data);
+      auto& read = reads[slot];
+      if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+        submitRead(ring, read, slot);
+        return;
+      }
+      if (cqe.res > 0) {
+        read.done += static_cast<size_t>(cqe.res);
+        if (read.done < read.data.size()) {
+          // a short read, ask for the rest
+          submitRead(ring, read, slot);
+          return;
+        }
+      }
+
+      // read it all, or the file shrunk since the stat, or failed
+      close(read.fd);
+      read.fd = -1;
+      read.data.resize(read.done);
+      // the header was sniffed when the file was opened
+      const bool ok = cqe.res >= 0 && read.done > 0;
+      readDone(read.file, read.path, move(read.data), ok);
+      read.data = FileBuffer();
+
+      busy[slot] = false;
+      freeSlots.push_back(slot);
+      --inFlight;
+    });
+  }
+}
+
+bool HashPipeline::openForRead(PendingRead& read) {
+  if (!table.loadCachedHashes(read.file, read.path)) {
+    bump(localCounters->cached);
+    return false;
+  }
+
+  do {
+    read.fd = open(read.path.c_str(), O_RDONLY | O_CLOEXEC);
+  } while (read.fd < 0 && errno == EINTR);
+  struct stat info;
+  if (read.fd < 0 || fstat(read.fd, &info) != 0 || info.st_size <= 0) {
+    if (read.fd >= 0) {
+      close(read.fd);
+      read.fd = -1;
+    }
+    table.calcHashes(read.file, read.path, Mat());
+    bump(localCounters->failed);
+    return false;
+  }
+
+  // sniffed before the buffer is sized, as readFileContents does, so a
+  // misnamed large file costs no more than its header
+  unsigned char header[imageHeaderSize];
+  const size_t headerSize = min(static_cast<size_t>(info.st_size), imageHeaderSize);
+  ssize_t res;
+  do {
+    res = pread(read.fd, header, headerSize, 0);
+  } while (res < 0 && errno == EINTR);
+  if (res != static_cast<ssize_t>(headerSize) || sniffImageFormat(header, headerSize) == ImageInfo::unknown) {
+    close(read.fd);
+    read.fd = -1;
+    table.calcHashes(read.file, read.path, Mat());
+    bump(localCounters->failed);
+    return false;
+  }
+
+  // the ring writes the rest of the file behind the header
+  read.data = takeBuffer();
+  read.data.resize(static_cast<size_t>(info.st_size));
+  copy(header, header + headerSize, read.data.begin());
+  read.done = headerSize;
+  return true;
+}
+
+void HashPipeline::submitRead(IoRing& ring, PendingRead& read, size_t slot) {
+  // the length is 32 bits, larger files take several reads
+  const size_t maxLength = size_t(1) << 30;
+  io_uring_sqe& sqe = ring.prepare();
+  sqe.opcode = IORING_OP_READ;
+  sqe.fd = read.fd;
+  sqe.addr = reinterpret_cast<uint64_t>(read.data.data() + read.done);
+  sqe.len = static_cast<uint32_t>(min(read.data.size() - read.done, maxLength));
+  sqe.off = read.done;
+  sqe.user_data = slot;
+}
+
+#else
+
+void HashPipeline::ringReadLoop(RingReader&) {
+  readLoop();
+}
+
+#endif
+
+void HashPipeline::readDone(FileTable::Id file, const string& path, FileBuffer&& data, bool ok) {
+  bump(localCounters->bytesRead, data.size());
+  if (!ok) {
+    // unreadable, or not an image after all
+    table.calcHashes(file, path, Mat());
+    bump(localCounters->failed);
+    giveBuffer(move(data));
+    return;
+  }
+
+  // the ends tell most files of one size apart, the byte compare in
+  // claimContent the rest
+  ReadFile item;
+  item.file = file;
+  item.key.size = data.size();
+  const size_t block = min(data.size(), contentBlockSize);
+  item.key.checksum = checksum64(data.data(), block, checksum64(data.data() + data.size() - block, block));
+  item.data = share(move(data));
+  if (claimContent(item, path)) {
+    hashQueue.push(move(item));
+  }
+}
+
+void HashPipeline::hashLoop() {
+  ReadFile item;
+  string path;
+  while (hashQueue.pop(item)) {
+    DecodeAdmission admission;
+    {
+      // the decoded image is gone before its memory is released
+      MemoryBudget::Reservation reservation;
+      const auto img = decodeImageForHashing(*item.data, decodeBudget, reservation, admission);
+      if (admission == DecodeAdmission::skipped) {
+        table.skipHashes(item.file);
+      } else {
+        table.calcHashes(item.file, table.path(item.file, path), img);
+      }
+    }
+    if (admission == DecodeAdmission::skipped) {
+      bump(localCounters->skipped);
+    } else {
+      bump(localCounters->decoded);
+      if (admission == DecodeAdmission::reduced) {
+        bump(localCounters->oversized);
+      }
+      if (table.isInvalidImage(item.file)) {
+        bump(localCounters->undecodable);
+      }
+    }
+    if (item.representative) {
+      completeContent(item, path);
+    }
+    item.data.reset();
+  }
+}
+
+bool HashPipeline::claimContent(ReadFile& item, const string& path) {
+  FileTable::Id representative = 0;
+  SharedBuffer original;
+  {
+    lock_guard<mutex> lock(contentMutex);
+    const auto done = finished.find(item.key);
+    if (done != finished.end()) {
+      representative = done->second;
+    } else {
+      const auto inserted = contents.emplace(item.key, Content());
+      auto& content = inserted.first->second;
+      if (inserted.second) {
+        content.representative = item.file;
+        content.data = item.data;
+        item.representative = true;
+        return true;
+      }
+      representative = content.representative;
+      original = content.data;
+    }
+  }
+
+  // the checksum only covers the ends, and is not made to resist collisions
+  const auto& data = *item.data;
+  if (!original) {
+    string originalPath;
+    if (!fileEquals(table.path(representative, originalPath), data)) {
+      // decoded on its own, the key stays with the first file
+      return true;
+    }
+    table.copyHashes(item.file, path, representative);
+    bump(localCounters->identical);
+    return false;
+  }
+  if (memcmp(data.data(), original->data(), data.size()) != 0) {
+    return true;
+  }
+  original.reset();
+
+  {
+    lock_guard<mutex> lock(contentMutex);
+    const auto found = contents.find(item.key);
+    if (found != contents.end() && found->second.representative == representative) {
+      // completeContent hands over the hashes
+      found->second.waiting.push_back(item.file);
+      return false;
+    }
+  }
+
+  // the original got its hashes while comparing
+  table.copyHashes(item.file, path, representative);
+  bump(localCounters->identical);
+  return false;
+}
+
+void HashPipeline::completeContent(const ReadFile& item, string& path) {
+  vector<FileTable::Id> waiting;
+  {
+    lock_guard<mutex> lock(contentMutex);
+    auto found = contents.find(item.key);
+    waiting.swap(found->second.waiting);
+    contents.erase(found);
+
+    // later copies are compared with the file instead of the buffer
+    if (finished.emplace(item.key, item.file).second) {
+      finishedOrder.push_back(item.key);
+      if (finishedOrder.size() > maxFinishedContents) {
+        finished.erase(finishedOrder.front());
+        finishedOrder.pop_front();
+      }
+    }
+  }
+
+  for (auto& file : waiting) {
+    table.copyHashes(file, table.path(file, path), item.file);
+  }
+  bump(localCounters->identical, waiting.size());
+}
@@ -0,0 +1,256 @@
+//
+//  HashPipeline.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef HashPipeline_hpp
+#define HashPipeline_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "BoundedQueue.hh"
+#include "FileTable.hh"
+#include "ImageReader.hh"
+#include "MemoryBudget.hh"
+
+class IoRing;
+
+using namespace std;
+
+/**
+ Hashes images while the directory walk is still finding them. Files handed
+ to submit go through two stages, each on its own threads and connected by
+ bounded queues:
+ - readers look the file up in the cache and, if it has to be hashed, read it
+   into memory. this is the stage waiting on the disk.
+ - hashers decode the file contents and compute the hashes, which keeps the
+   cores busy.
+ Byte identical files are decoded once: the reader checksums the first and
+ last block of what it read, and a file with the size and block checksum of
+ one decoded before is compared with it byte for byte. If they are equal it
+ gets that one's hashes, waiting for them if they are not done yet, instead
+ of being decoded again. Files being decoded are compared in memory, the
+ last maxFinishedContents decoded ones are read again to compare. Copies
+ of older ones are decoded again.
+ Hard links are not read at all: a file on the device and inode of one
+ submitted before gets that one's hashes in finish.
+ A full queue makes the stage before it wait, so the files held in memory are
+ limited by the queue sizes. The buffers files are read into are pooled, and
+ go back to the pool once the hasher has decoded them.
+ With an io depth, each reader keeps that many reads in flight through
+ io_uring instead of reading one file at a time, so the depth can be tuned
+ for the storage while the hashers match the cores. Without io_uring in the
+ kernel the readers read one file at a time.
+ The hashers reserve the memory a decode is estimated to take in a budget
+ shared with the other decodes, see MemoryBudget.
+ */
+class HashPipeline {
+public:
+  // hashes rows of table. readerCount or hasherCount 0 picks a default,
+  // ioDepth 0 reads one file at a time on each reader
+  HashPipeline(FileTable& table, size_t readerCount, size_t hasherCount, unsigned ioDepth,
+               MemoryBudget& decodeBudget);
+  // waits for the queued files
+  ~HashPipeline();
+  HashPipeline(const HashPipeline&) = delete;
+  HashPipeline& operator=(const HashPipeline&) = delete;
+
+  // queues an image for hashing, waits while the read queue is full. a hard
+  // link to a file submitted before is not queued. may be called from
+  // several threads at once.
+  void submit(FileTable::Id file);
+
+  // waits until every submitted file has its hashes, or is marked as an
+  // invalid image, and hands the hashes on to the hard links. submit must
+  // not be called afterwards.
+  void finish();
+
+  // hard links which got the hashes of the file they link to, valid after
+  // finish
+  size_t linkedCount() const { return linkedFiles.load(memory_order_relaxed); }
+
+  // files which got the hashes of a byte identical one, valid after finish
+  size_t identicalCount() const { return sum(&ThreadCounters::identical); }
+  // files which had their hashes in the cache
+  size_t cachedCount() const { return sum(&ThreadCounters::cached); }
+  // files decoded and hashed, and the bytes read for all files read
+  size_t decodeCount() const { return sum(&ThreadCounters::decoded); }
+  uint64_t bytesRead() const { return sum(&ThreadCounters::bytesRead); }
+  // jpegs too large for the decode budget, decoded at the largest reduction
+  size_t oversizedCount() const { return sum(&ThreadCounters::oversized); }
+  // images too large for the decode budget at any size, not decoded
+  size_t skippedCount() const { return sum(&ThreadCounters::skipped); }
+  // files found to be unreadable or not decodable
+  size_t invalidCount() const { return sum(&ThreadCounters::failed) + sum(&ThreadCounters::undecodable); }
+  // the cpu time of the reader and of the hasher threads, valid after finish
+  double readerCpuSeconds() const { return static_cast<double>(readerCpuNs) / 1e9; }
+  double hasherCpuSeconds() const { return static_cast<double>(hasherCpuNs) / 1e9; }
+
+  // true if the readers read through io_uring
+  bool readsAsynchronously() const { return !ringReaders.empty(); }
+
+  // how far the pipeline got, for reporting progress while it runs
+  struct Progress {
+    uint64_t submitted = 0;
+    // files which got their hashes, or were found to be invalid
+    uint64_t done = 0;
+    uint64_t cached = 0;
+    uint64_t decoded = 0;
+    uint64_t bytesRead = 0;
+  };
+  // may be called from any thread at any time, the counts are not taken
+  // at one instant but each is up to date
+  Progress progress() const;
+
+  static constexpr size_t defaultReaderCount = 4;
+  static constexpr unsigned defaultIoDepth = 32;
+  // decoded files remembered for their copies
+  static constexpr size_t maxFinishedContents = size_t(1) << 16;
+
+private:
+  // the size and a checksum of the first and last block, equal for
+  // identical files. files with equal keys are compared byte for byte.
+  struct ContentKey {
+    uint64_t size;
+    uint64_t checksum;
+
+    bool operator==(const ContentKey& other) const {
+      return size == other.size && checksum == other.checksum;
+    }
+  };
+
+  struct ContentKeyHash {
+    size_t operator()(const ContentKey& key) const { return key.checksum; }
+  };
+
+  // the device and inode of a file
+  struct InodeKey {
+    uint64_t device;
+    uint64_t inode;
+
+    bool operator==(const InodeKey& other) const {
+      return device == other.device && inode == other.inode;
+    }
+  };
+
+  struct InodeKeyHash {
+    size_t operator()(const InodeKey& key) const { return key.inode * 31 + key.device; }
+  };
+
+  // read file contents, shared by the hasher decoding them and the readers
+  // comparing their files with them. back to the pool with the last owner.
+  using SharedBuffer = shared_ptr<const FileBuffer>;
+
+  // the file being decoded for some content, and the files waiting for it.
+  // dropped once the waiting files got its hashes.
+  struct Content {
+    FileTable::Id representative = 0;
+    SharedBuffer data;
+    vector<FileTable::Id> waiting;
+  };
+
+  // the counts of one reader or hasher thread. only that thread writes
+  // them, and each is on a cache line of its own, so counting costs no
+  // locked instructions or shared lines.
+  struct alignas(64) ThreadCounters {
+    atomic<uint64_t> cached{0};
+    // unreadable, or not an image by the header
+    atomic<uint64_t> failed{0};
+    atomic<uint64_t> decoded{0};
+    atomic<uint64_t> undecodable{0};
+    atomic<uint64_t> oversized{0};
+    atomic<uint64_t> skipped{0};
+    atomic<uint64_t> identical{0};
+    atomic<uint64_t> bytesRead{0};
+  };
+
+  struct ReadFile {
+    FileTable::Id file = 0;
+    ContentKey key;
+    SharedBuffer data;
+    // true if files with the same contents wait for this one
+    bool representative = false;
+  };
+
+  // a read in flight on a ring
+  struct PendingRead {
+    FileTable::Id file = 0;
+    string path;
+    int fd = -1;
+    FileBuffer data;
+    size_t done = 0;
+  };
+
+  // the ring of a reader thread, and its reads
+  struct RingReader {
+    unique_ptr<IoRing> ring;
+    vector<PendingRead> reads;
+  };
+
+  void readLoop();
+  void ringReadLoop(RingReader& reader);
+  void hashLoop();
+  // looks the file up in the cache, and opens it if it has to be read.
+  // false if there is nothing to read.
+  bool openForRead(PendingRead& read);
+  // queues the read for the part of the file not read yet
+  void submitRead(IoRing& ring, PendingRead& read, size_t slot);
+  // checksums what was read and queues it for hashing, or marks the file
+  // invalid if reading failed or it is not an image
+  void readDone(FileTable::Id file, const string& path, FileBuffer&& data, bool ok);
+  FileBuffer takeBuffer();
+  void giveBuffer(FileBuffer&& buffer);
+  SharedBuffer share(FileBuffer&& buffer);
+  uint64_t sum(atomic<uint64_t> ThreadCounters::*counter) const;
+  // true if item has to be decoded, false if it gets the hashes of a file
+  // with the same contents. sets item.representative.
+  bool claimContent(ReadFile& item, const string& path);
+  // hands the hashes of item to the files waiting for them. path is a
+  // buffer for their paths.
+  void completeContent(const ReadFile& item, string& path);
+
+  FileTable& table;
+  MemoryBudget& decodeBudget;
+  vector<RingReader> ringReaders;
+  BoundedQueue<FileTable::Id> readQueue;
+  BoundedQueue<ReadFile> hashQueue;
+  mutex inodeMutex;
+  // the first file submitted for each inode, and the hard links submitted
+  // after it with the file they link to
+  unordered_map<InodeKey, FileTable::Id, InodeKeyHash> inodes;
+  vector<pair<FileTable::Id, FileTable::Id>> links;
+  mutex contentMutex;
+  // the contents being decoded
+  unordered_map<ContentKey, Content, ContentKeyHash> contents;
+  // the file decoded for some of the contents decoded before, and their
+  // keys oldest first
+  unordered_map<ContentKey, FileTable::Id, ContentKeyHash> finished;
+  deque<ContentKey> finishedOrder;
+  // a slot for each reader, then one for each hasher
+  unique_ptr<ThreadCounters[]> counters;
+  size_t counterCount = 0;
+  // the counters of the pipeline thread running on this thread
+  static thread_local ThreadCounters* localCounters;
+  atomic<uint64_t> submittedFiles{0};
+  atomic<uint64_t> linkedFiles{0};
+  atomic<uint64_t> readerCpuNs{0};
+  atomic<uint64_t> hasherCpuNs{0};
+  mutex bufferMutex;
+  vector<FileBuffer> freeBuffers;
+  // the last reader to finish closes the hash queue
+  atomic<size_t> activeReaders;
+  vector<thread> readers;
+  vector<thread> hashers;
+};
+
+#endif /* HashPipeline_hpp */
@@ -0,0 +1,75 @@
+//
+//  ImageHash.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef ImageHash_hpp
+#define ImageHash_hpp
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+/**
+ A perceptual hash of a fixed number of bytes stored inline as 64 bit words.
+ Byte i of the opencv hash lives in bits 8*(i%8)..8*(i%8)+7 of word i/8, the
+ unused high bytes of the last word are always zero.
+ */
+template <size_t Bytes>
+class FixedHash {
+public:
+  static constexpr size_t byteCount = Bytes;
+  static constexpr size_t wordCount = (Bytes + 7) / 8;
+
+  FixedHash() : words() {}
+
+  // takes the first Bytes bytes of a CV_8U hash as computed by cv::img_hash
+  static FixedHash fromMat(const cv::Mat& hash) {
+    FixedHash result;
+    if (!hash.empty()) {
+      const auto count = hash.total() * hash.elemSize();
+      const unsigned char* data = hash.ptr(0);
+      for (size_t i = 0; i < Bytes && i < count; ++i) {
+        result.setByte(i, data[i]);
+      }
+    }
+
+    return result;
+  }
+
+  uint8_t byte(size_t i) const {
+    return static_cast<uint8_t>(words[i / 8] >> (8 * (i % 8)));
+  }
+
+  void setByte(size_t i, uint8_t value) {
+    const auto shift = 8 * (i % 8);
+    words[i / 8] = (words[i / 8] & ~(uint64_t(0xff) << shift)) | (uint64_t(value) << shift);
+  }
+
+  uint64_t word(size_t i) const { return words[i]; }
+  void setWord(size_t i, uint64_t value) { words[i] = value; }
+
+  // hamming distance, a popcount per word
+  int distance(const FixedHash& other) const {
+    int result = 0;
+    for (size_t i = 0; i < wordCount; ++i) {
+      result += __builtin_popcountll(words[i] ^ other.words[i]);
+    }
+
+    return result;
+  }
+
+  bool operator==(const FixedHash& other) const { return words == other.words; }
+  bool operator!=(const FixedHash& other) const { return words != other.words; }
+
+private:
+  std::array<uint64_t, wordCount> words;
+};
+
+// AverageHash and PHash both produce 8 bytes
+using ImageHash = FixedHash<8>;
+
+#endif /* ImageHash_hpp */
@@ -0,0 +1,516 @@
+//
+//  ImageReader.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "ImageReader.hh"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// os
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+// closes the file when going out of scope
+class FileDescriptor {
+public:
+  explicit FileDescriptor(const string& path) {
+    do {
+      fd = open(path.c_str(), O_RDONLY);
+    } while (fd < 0 && errno == EINTR);
+  }
+  ~FileDescriptor() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  FileDescriptor(const FileDescriptor&) = delete;
+  FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+  bool isOpen() const { return fd >= 0; }
+
+  bool readAt(off_t offset, unsigned char* buffer, size_t size) const {
+    ssize_t res;
+    do {
+      res = pread(fd, buffer, size, offset);
+    } while (res < 0 && errno == EINTR);
+    return res == static_cast<ssize_t>(size);
+  }
+
+  int get() const { return fd; }
+
+private:
+  int fd = -1;
+};
+
+// the same readAt for a file already in memory
+class MemoryBuffer {
+public:
+  MemoryBuffer(const unsigned char* data, size_t size) : data(data), size(size) {}
+
+  bool readAt(off_t offset, unsigned char* buffer, size_t count) const {
+    if (offset < 0 || static_cast<size_t>(offset) > size || size - static_cast<size_t>(offset) < count) {
+      return false;
+    }
+    copy(data + offset, data + offset + count, buffer);
+    return true;
+  }
+
+private:
+  const unsigned char* data;
+  size_t size;
+};
+
+// the formats we hash, lower case without the dot. opencv decodes more, but
+// these are the ones found in photo libraries.
+constexpr array<string_view, 8> imageExtensions = {
+  "jpg", "jpeg", "jpe", "png", "webp", "tif", "tiff", "bmp"
+};
+
+constexpr size_t longestImageExtension() {
+  size_t longest = 0;
+  for (auto extension : imageExtensions) {
+    longest = max(longest, extension.size());
+  }
+  return longest;
+}
+
+unsigned bigEndian16(const unsigned char* p) {
+  return (unsigned(p[0]) << 8) | p[1];
+}
+
+uint32_t bigEndian32(const unsigned char* p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint32_t littleEndian32(const unsigned char* p) {
+  return (uint32_t(p[3]) << 24) | (uint32_t(p[2]) << 16) | (uint32_t(p[1]) << 8) | p[0];
+}
+
+unsigned littleEndian16(const unsigned char* p) {
+  return (unsigned(p[1]) << 8) | p[0];
+}
+
+uint32_t littleEndian24(const unsigned char* p) {
+  return (uint32_t(p[2]) << 16) | (uint32_t(p[1]) << 8) | p[0];
+}
+
+template <class Source>
+bool readPngInfo(const Source& file, ImageInfo& info) {
+  // signature, then the IHDR chunk: length, type, width, height
+  unsigned char header[24];
+  if (!file.readAt(0, header, sizeof(header)) || bigEndian32(header + 12) != 0x49484452) {
+    return false;
+  }
+
+  info.width = static_cast<int>(bigEndian32(header + 16));
+  info.height = static_cast<int>(bigEndian32(header + 20));
+  return info.width > 0 && info.height > 0;
+}
+
+bool isStartOfFrame(unsigned char marker) {
+  // SOF0..SOF15, except DHT (c4), JPG (c8) and DAC (cc)
+  return marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+}
+
+template <class Source>
+bool readJpegInfo(const Source& file, ImageInfo& info) {
+  // walk the marker segments after SOI until the frame header
+  off_t offset = 2;
+  unsigned char segment[9];
+  for (int segments = 0; segments < 1000; ++segments) {
+    if (!file.readAt(offset, segment, 4) || segment[0] != 0xff) {
+      return false;
+    }
+
+    const unsigned char marker = segment[1];
+    if (marker == 0xff) {
+      // fill byte
+      ++offset;
+      continue;
+    }
+
+    if (marker == 0xd9 || marker == 0xda) {
+      // end of image or start of scan without a frame header
+      return false;
+    }
+
+    const unsigned length = bigEndian16(segment + 2);
+    if (isStartOfFrame(marker)) {
+      // length, precision, height, width
+      if (!file.readAt(offset, segment, sizeof(segment))) {
+        return false;
+      }
+      info.height = static_cast<int>(bigEndian16(segment + 5));
+      info.width = static_cast<int>(bigEndian16(segment + 7));
+      return info.width > 0 && info.height > 0;
+    }
+
+    if (length < 2) {
+      return false;
+    }
+    offset += 2 + static_cast<off_t>(length);
+  }
+
+  return false;
+}
+
+template <class Source>
+bool readBmpInfo(const Source& file, ImageInfo& info) {
+  // file header, then the size of the info header, width and height
+  unsigned char header[26];
+  if (!file.readAt(0, header, sizeof(header))) {
+    return false;
+  }
+
+  info.width = static_cast<int>(littleEndian32(header + 18));
+  // negative for images stored top down
+  const auto height = static_cast<int32_t>(littleEndian32(header + 22));
+  info.height = height == INT32_MIN ? 0 : abs(height);
+  return info.width > 0 && info.height > 0;
+}
+
+template <class Source>
+bool readTiffInfo(const Source& file, ImageInfo& info) {
+  // byte order, 42, and the offset of the first image file directory
+  unsigned char header[8];
+  if (!file.readAt(0, header, sizeof(header))) {
+    return false;
+  }
+  const bool little = header[0] == 'I';
+  const auto read16 = [little](const unsigned char* p) { return little ? littleEndian16(p) : bigEndian16(p); };
+  const auto read32 = [little](const unsigned char* p) { return little ? littleEndian32(p) : bigEndian32(p); };
+
+  const off_t directory = read32(header + 4);
+  unsigned char count[2];
+  if (!file.readAt(directory, count, sizeof(count))) {
+    return false;
+  }
+  // entries of tag, type, count and a value which fits in 4 bytes
+  const unsigned entries = min(read16(count), 1000u);
+  for (unsigned i = 0; i < entries && (info.width == 0 || info.height == 0); ++i) {
+    unsigned char entry[12];
+    if (!file.readAt(directory + 2 + 12 * static_cast<off_t>(i), entry, sizeof(entry))) {
+      return false;
+    }
+    const unsigned tag = read16(entry);
+    const unsigned type = read16(entry + 2);
+    if (tag != 256 && tag != 257) {
+      continue;
+    }
+    // SHORT or LONG
+    const uint32_t value = type == 3 ? read16(entry + 8) : type == 4 ? read32(entry + 8) : 0;
+    const int dimension = value > INT32_MAX ? 0 : static_cast<int>(value);
+    (tag == 256 ? info.width : info.height) = dimension;
+  }
+  return info.width > 0 && info.height > 0;
+}
+
+template <class Source>
+bool readWebpInfo(const Source& file, ImageInfo& info) {
+  // RIFF header, then the first chunk: fourcc, size and its start
+  unsigned char header[30];
+  if (!file.readAt(0, header, sizeof(header))) {
+    return false;
+  }
+
+  const unsigned char* chunk = header + 12;
+  const unsigned char* data = chunk + 8;
+  if (memcmp(chunk, "VP8 ", 4) == 0) {
+    // lossy: frame tag, start code, then 14 bit width and height
+    if (data[3] != 0x9d || data[4] != 0x01 || data[5] != 0x2a) {
+      return false;
+    }
+    info.width = static_cast<int>(littleEndian16(data + 6) & 0x3fff);
+    info.height = static_cast<int>(littleEndian16(data + 8) & 0x3fff);
+  } else if (memcmp(chunk, "VP8L", 4) == 0) {
+    // lossless: signature, then width - 1 and height - 1 in 14 bits each
+    if (data[0] != 0x2f) {
+      return false;
+    }
+    const uint32_t bits = littleEndian32(data + 1);
+    info.width = static_cast<int>(bits & 0x3fff) + 1;
+    info.height = static_cast<int>((bits >> 14) & 0x3fff) + 1;
+  } else if (memcmp(chunk, "VP8X", 4) == 0) {
+    // extended: flags, then the canvas width - 1 and height - 1 in 24 bits
+    info.width = static_cast<int>(littleEndian24(data + 4)) + 1;
+    info.height = static_cast<int>(littleEndian24(data + 7)) + 1;
+  }
+  return info.width > 0 && info.height > 0;
+}
+
+template <class Source>
+bool readImageInfo(const Source& file, ImageInfo& info) {
+  info = ImageInfo();
+  unsigned char header[imageHeaderSize];
+  if (!file.readAt(0, header, sizeof(header))) {
+    return false;
+  }
+
+  // the format stays set when the dimensions can not be read, the decoder
+  // may still manage
+  info.format = sniffImageFormat(header, sizeof(header));
+  switch (info.format) {
+  case ImageInfo::jpeg:
+    return readJpegInfo(file, info);
+  case ImageInfo::png:
+    return readPngInfo(file, info);
+  case ImageInfo::bmp:
+    return readBmpInfo(file, info);
+  case ImageInfo::webp:
+    return readWebpInfo(file, info);
+  case ImageInfo::tiff:
+    return readTiffInfo(file, info);
+  case ImageInfo::unknown:
+    break;
+  }
+
+  return false;
+}
+
+} // namespace
+
+bool hasImageExtension(string_view name) {
+  const auto dot = name.rfind('.');
+  if (dot == string_view::npos || name.size() - dot - 1 > longestImageExtension()) {
+    return false;
+  }
+
+  char extension[longestImageExtension()];
+  const size_t length = name.size() - dot - 1;
+  for (size_t i = 0; i < length; ++i) {
+    const char c = name[dot + 1 + i];
+    extension[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+  }
+
+  const string_view lowered(extension, length);
+  return find(imageExtensions.begin(), imageExtensions.end(), lowered) != imageExtensions.end();
+}
+
+ImageInfo::Format sniffImageFormat(const unsigned char* header, size_t size) {
+  static const unsigned char pngMagic[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  if (size >= 3 && header[0] == 0xff && header[1] == 0xd8 && header[2] == 0xff) {
+    return ImageInfo::jpeg;
+  }
+  if (size >= 8 && memcmp(header, pngMagic, 8) == 0) {
+    return ImageInfo::png;
+  }
+  if (size >= 12 && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WEBP", 4) == 0) {
+    return ImageInfo::webp;
+  }
+  if (size >= 4 && (memcmp(header, "II*\0", 4) == 0 || memcmp(header, "MM\0*", 4) == 0)) {
+    return ImageInfo::tiff;
+  }
+  // the two reserved words of the file header are zero
+  if (size >= 10 && header[0] == 'B' && header[1] == 'M' && littleEndian32(header + 6) == 0) {
+    return ImageInfo::bmp;
+  }
+  return ImageInfo::unknown;
+}
+
+bool readImageInfo(const string& path, ImageInfo& info) {
+  FileDescriptor file(path);
+  if (!file.isOpen()) {
+    info = ImageInfo();
+    return false;
+  }
+  return readImageInfo(file, info);
+}
+
+bool readImageInfo(const FileBuffer& data, ImageInfo& info) {
+  return readImageInfo(MemoryBuffer(data.data(), data.size()), info);
+}
+
+int hashDecodeFlags(const ImageInfo& info) {
+  // only the jpeg decoder scales while decoding, other formats would be
+  // decoded in full and resized afterwards
+  if (info.format == ImageInfo::jpeg) {
+    const int minSide = min(info.width, info.height);
+    if (minSide >= 8 * hashMinSide) {
+      return IMREAD_REDUCED_GRAYSCALE_8;
+    } else if (minSide >= 4 * hashMinSide) {
+      return IMREAD_REDUCED_GRAYSCALE_4;
+    } else if (minSide >= 2 * hashMinSide) {
+      return IMREAD_REDUCED_GRAYSCALE_2;
+    }
+  }
+
+  return IMREAD_GRAYSCALE;
+}
+
+namespace {
+
+// the decode flags for info of a file of fileSize bytes, with the memory
+// reserved in budget. nothing is reserved for a skipped image.
+int admitDecode(const ImageInfo& info, uint64_t fileSize, MemoryBudget& budget,
+                MemoryBudget::Reservation& reservation, DecodeAdmission& admission) {
+  int flags = hashDecodeFlags(info);
+  admission = DecodeAdmission::admitted;
+  if (info.width <= 0 || info.height <= 0) {
+    // the header did not tell the size. few images decode to more than
+    // the estimate, the budget caps what is charged.
+    reservation = budget.reserve(fileSize * unknownDecodeFactor);
+    return flags;
+  }
+  if (budget.exceeds(hashDecodeMemory(info, flags)) && info.format == ImageInfo::jpeg) {
+    // a short side under hashMinSide, the hashes sample 32x32 pixels at most
+    flags = IMREAD_REDUCED_GRAYSCALE_8;
+    admission = DecodeAdmission::reduced;
+  }
+  if (budget.exceeds(hashDecodeMemory(info, flags))) {
+    // the other decoders only reduce after decoding in full
+    admission = DecodeAdmission::skipped;
+    return flags;
+  }
+  reservation = budget.reserve(hashDecodeMemory(info, flags));
+  return flags;
+}
+
+Mat decode(const FileBuffer& data, int flags) {
+  try {
+    // a header over the buffer, imdecode does not write to it
+    const Mat encoded(1, static_cast<int>(data.size()), CV_8U, const_cast<unsigned char*>(data.data()));
+    return imdecode(encoded, flags);
+  } catch (const cv::Exception&) {
+    // damaged files are invalid images, not a reason to stop the scan
+    return Mat();
+  }
+}
+
+} // namespace
+
+uint64_t hashDecodeMemory(const ImageInfo& info, int flags) {
+  const uint64_t pixels = static_cast<uint64_t>(info.width) * static_cast<uint64_t>(info.height);
+  switch (info.format) {
+  case ImageInfo::jpeg: {
+    uint64_t scale = 1;
+    if (flags == IMREAD_REDUCED_GRAYSCALE_8) {
+      scale = 8;
+    } else if (flags == IMREAD_REDUCED_GRAYSCALE_4) {
+      scale = 4;
+    } else if (flags == IMREAD_REDUCED_GRAYSCALE_2) {
+      scale = 2;
+    }
+    return pixels / (scale * scale);
+  }
+  case ImageInfo::png:
+  case ImageInfo::bmp:
+    // converted row by row, 16 bit rows on the way
+    return pixels * 2;
+  case ImageInfo::tiff:
+    // strips in up to 16 bits per channel, and the gray image
+    return pixels * 7;
+  case ImageInfo::webp:
+    // decoded to color first
+    return pixels * 4;
+  case ImageInfo::unknown:
+    break;
+  }
+  return 0;
+}
+
+Mat readImageForHashing(const string& path) {
+  ImageInfo info;
+  readImageInfo(path, info);
+  if (info.format == ImageInfo::unknown) {
+    // not an image, whatever the name says. the decoder would find out only
+    // after reading all of it.
+    return Mat();
+  }
+  return imread(path, hashDecodeFlags(info));
+}
+
+bool readFileContents(const string& path, FileBuffer& data) {
+  data.clear();
+  FileDescriptor file(path);
+  struct stat info;
+  if (!file.isOpen() || fstat(file.get(), &info) != 0 || info.st_size <= 0) {
+    return false;
+  }
+
+  // sniffed before the buffer is sized, a misnamed large file costs no more
+  // than the header
+  unsigned char header[imageHeaderSize];
+  const size_t headerSize = min(static_cast<size_t>(info.st_size), imageHeaderSize);
+  if (!file.readAt(0, header, headerSize) || sniffImageFormat(header, headerSize) == ImageInfo::unknown) {
+    // misnamed, or not readable at all
+    return false;
+  }
+
+  data.resize(static_cast<size_t>(info.st_size));
+  copy(header, header + headerSize, data.begin());
+  size_t done = headerSize;
+  while (done < data.size()) {
+    ssize_t res;
+    do {
+      res = pread(file.get(), data.data() + done, data.size() - done, static_cast<off_t>(done));
+    } while (res < 0 && errno == EINTR);
+    if (res <= 0) {
+      // error, or the file shrunk since the stat
+      data.resize(done);
+      return res == 0 && done > 0;
+    }
+    done += static_cast<size_t>(res);
+  }
+  return true;
+}
+
+Mat decodeImageForHashing(const FileBuffer& data) {
+  if (data.empty()) {
+    return Mat();
+  }
+  ImageInfo info;
+  readImageInfo(data, info);
+  if (info.format == ImageInfo::unknown) {
+    return Mat();
+  }
+  return decode(data, hashDecodeFlags(info));
+}
+
+Mat decodeImageForHashing(const FileBuffer& data, MemoryBudget& budget,
+                          MemoryBudget::Reservation& reservation, DecodeAdmission& admission) {
+  admission = DecodeAdmission::admitted;
+  if (data.empty()) {
+    return Mat();
+  }
+  ImageInfo info;
+  readImageInfo(data, info);
+  if (info.format == ImageInfo::unknown) {
+    return Mat();
+  }
+  const int flags = admitDecode(info, data.size(), budget, reservation, admission);
+  if (admission == DecodeAdmission::skipped) {
+    return Mat();
+  }
+  return decode(data, flags);
+}
+
+Mat readImageForHashing(const string& path, MemoryBudget& budget,
+                        MemoryBudget::Reservation& reservation, DecodeAdmission& admission) {
+  admission = DecodeAdmission::admitted;
+  ImageInfo info;
+  readImageInfo(path, info);
+  if (info.format == ImageInfo::unknown) {
+    return Mat();
+  }
+  struct stat file;
+  const uint64_t fileSize = stat(path.c_str(), &file) == 0 ? static_cast<uint64_t>(file.st_size) : 0;
+  const int flags = admitDecode(info, fileSize, budget, reservation, admission);
+  if (admission == DecodeAdmission::skipped) {
+    return Mat();
+  }
+  return imread(path, flags);
+}
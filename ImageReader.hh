@@ -0,0 +1,149 @@
+//
+//  ImageReader.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef ImageReader_hpp
+#define ImageReader_hpp
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "MemoryBudget.hh"
+
+/**
+ * an allocator which leaves the elements a vector grows by uninitialized,
+ * so sizing a buffer for a file does not write all of it before the read
+ * does.
+ */
+template <class T>
+struct UninitializedAllocator : std::allocator<T> {
+  template <class U>
+  struct rebind {
+    using other = UninitializedAllocator<U>;
+  };
+
+  UninitializedAllocator() = default;
+  template <class U>
+  UninitializedAllocator(const UninitializedAllocator<U>&) noexcept {}
+
+  template <class U>
+  void construct(U* p) noexcept {
+    ::new (static_cast<void*>(p)) U;
+  }
+  template <class U, class... Args>
+  void construct(U* p, Args&&... args) {
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+};
+
+// the contents of a file, read to be decoded
+using FileBuffer = std::vector<unsigned char, UninitializedAllocator<unsigned char>>;
+
+struct ImageInfo {
+  enum Format { unknown, jpeg, png, webp, tiff, bmp };
+  Format format = unknown;
+  int width = 0;
+  int height = 0;
+};
+
+/**
+ * true if the name ends in the extension of a format we hash, in any case.
+ * the extensions are in a table built at compile time.
+ */
+bool hasImageExtension(std::string_view name);
+
+// the bytes sniffImageFormat looks at
+const size_t imageHeaderSize = 16;
+
+/**
+ * recognizes the image format from the first bytes of the file, or returns
+ * unknown. size may be less than imageHeaderSize for short files.
+ */
+ImageInfo::Format sniffImageFormat(const unsigned char* header, size_t size);
+
+/**
+ * reads the image dimensions from the file header, without decoding.
+ * @return false if the format is not recognized or the header is damaged
+ */
+bool readImageInfo(const std::string& path, ImageInfo& info);
+// the same for a file already read into memory
+bool readImageInfo(const FileBuffer& data, ImageInfo& info);
+
+/**
+ * imread flags for hashing: grayscale, and for jpeg the largest decoder
+ * downscale (2, 4 or 8) which keeps the short side at hashMinSide pixels
+ * or more.
+ */
+int hashDecodeFlags(const ImageInfo& info);
+
+// the short side the hashing decode is reduced to at most, aHash and pHash
+// sample 8x8 and 32x32 pixels of it
+const int hashMinSide = 256;
+
+/**
+ * decodes path once for both aHash and pHash. returns an empty Mat if the
+ * file could not be decoded, or its header is not one of an image format.
+ */
+cv::Mat readImageForHashing(const std::string& path);
+
+/**
+ * reads the whole file into data, so it can be decoded on another thread.
+ * the header is read first with a single pread, and a file which is not in
+ * a format we hash is not read any further.
+ * @return false if the file could not be read or is not an image
+ */
+bool readFileContents(const std::string& path, FileBuffer& data);
+
+/**
+ * decodes a file read by readFileContents the same way readImageForHashing
+ * decodes from disk. returns an empty Mat if data is not a decodable image.
+ */
+cv::Mat decodeImageForHashing(const FileBuffer& data);
+
+/**
+ * the bytes a decode with flags is estimated to take at its peak. jpeg is
+ * decoded to gray at the reduced size, the other decoders may hold the
+ * image in color or with 16 bits per channel before converting it.
+ * 0 if info has no dimensions.
+ */
+uint64_t hashDecodeMemory(const ImageInfo& info, int flags);
+
+// what a decode within a memory budget did with an image
+enum class DecodeAdmission {
+  // decoded as it would be without a budget
+  admitted,
+  // a jpeg which needs more than the whole budget, decoded at the largest
+  // reduction
+  reduced,
+  // needs more than the whole budget at any size its decoder offers, not
+  // decoded
+  skipped
+};
+
+// the bytes an image whose header does not give its dimensions is charged
+// for each byte of the file
+const uint64_t unknownDecodeFactor = 16;
+
+/**
+ * decodes like decodeImageForHashing once the estimated memory of the
+ * decode fits into budget. the memory stays in reservation, release it when
+ * the Mat is gone. a jpeg which needs more than the whole budget is decoded
+ * at the largest reduction, if that fits. other images which need more are
+ * not decoded, the Mat is empty and admission says skipped. an image whose
+ * header does not give its dimensions is charged unknownDecodeFactor times
+ * its file size, at most the whole budget.
+ */
+cv::Mat decodeImageForHashing(const FileBuffer& data, MemoryBudget& budget,
+                              MemoryBudget::Reservation& reservation, DecodeAdmission& admission);
+// the same for readImageForHashing
+cv::Mat readImageForHashing(const std::string& path, MemoryBudget& budget,
+                            MemoryBudget::Reservation& reservation, DecodeAdmission& admission);
+
+#endif /* ImageReader_hpp */
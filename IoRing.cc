@@ -0,0 +1,126 @@
+//
+//  IoRing.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "config.h"
+
+#include "IoRing.hh"
+
+#ifdef RDFIND_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+IoRing::IoRing(unsigned entries, std::initializer_list<uint8_t> opcodes) {
+  // sqes is only set once everything else is, so valid() tells
+  setup(entries, opcodes);
+}
+
+bool IoRing::setup(unsigned entries, std::initializer_list<uint8_t> opcodes) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (fd < 0) {
+    // not in the kernel, or not allowed
+    return false;
+  }
+
+  // the probe came in linux 5.6, like statx and read on the ring
+  const unsigned probeOps = 256;
+  std::vector<char> probeBuffer(sizeof(io_uring_probe) + probeOps * sizeof(io_uring_probe_op));
+  auto* probe = reinterpret_cast<io_uring_probe*>(probeBuffer.data());
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, probeOps) < 0) {
+    return false;
+  }
+  for (auto op : opcodes) {
+    if (probe->last_op < op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+      return false;
+    }
+  }
+
+  sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMap) {
+    sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+  }
+
+  void* map = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  sqMap = map;
+  if (!singleMap) {
+    map = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (map == MAP_FAILED) {
+      return false;
+    }
+    cqMap = map;
+  }
+  sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  map = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  sqes = static_cast<io_uring_sqe*>(map);
+
+  auto* sq = static_cast<char*>(sqMap);
+  auto* cq = static_cast<char*>(singleMap ? sqMap : cqMap);
+  sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sqEntries = params.sq_entries;
+  sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  sqLocalTail = *sqTail;
+  cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  return true;
+}
+
+IoRing::~IoRing() {
+  if (sqes != nullptr) {
+    munmap(sqes, sqesSize);
+  }
+  if (cqMap != nullptr) {
+    munmap(cqMap, cqMapSize);
+  }
+  if (sqMap != nullptr) {
+    munmap(sqMap, sqMapSize);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+io_uring_sqe& IoRing::prepare() {
+  const unsigned index = sqLocalTail & sqMask;
+  io_uring_sqe& sqe = sqes[index];
+  memset(&sqe, 0, sizeof(sqe));
+  sqArray[index] = index;
+  ++sqLocalTail;
+  return sqe;
+}
+
+bool IoRing::submit(unsigned wait) {
+  __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+  // what the kernel has not taken yet, which includes entries from a call
+  // that was interrupted
+  const unsigned pending = sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+  const unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+  if (syscall(__NR_io_uring_enter, fd, pending, wait, flags, nullptr, 0) < 0) {
+    return errno == EINTR || errno == EAGAIN || errno == EBUSY;
+  }
+  return true;
+}
+
+#endif
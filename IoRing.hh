@@ -0,0 +1,98 @@
+//
+//  IoRing.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef IoRing_hpp
+#define IoRing_hpp
+
+// include config.h before this, it tells if linux/io_uring.h is there
+#if defined(__linux__) && defined(HAVE_LINUX_IO_URING_H)
+#define RDFIND_IO_URING 1
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+/**
+ An io_uring instance, set up with the raw system calls so there is no
+ dependency on liburing. The caller fills in submission entries, submits
+ them and handles the completions, keeping at most capacity() requests in
+ flight so the completion queue can not overflow.
+ Used by one thread at a time.
+ */
+class IoRing {
+public:
+  // a ring for entries requests. not valid if io_uring is not available,
+  // or does not have one of opcodes.
+  IoRing(unsigned entries, std::initializer_list<uint8_t> opcodes);
+  ~IoRing();
+  IoRing(const IoRing&) = delete;
+  IoRing& operator=(const IoRing&) = delete;
+
+  bool valid() const { return sqes != nullptr; }
+
+  // requests which can be in flight at once
+  unsigned capacity() const { return sqEntries; }
+
+  // a cleared submission entry, queued with the next submit
+  io_uring_sqe& prepare();
+
+  /**
+   * submits the prepared entries and waits until at least wait requests
+   * have completed. false if the ring failed, requests in flight may then
+   * still write to their buffers, so keep them and the ring around.
+   */
+  bool submit(unsigned wait);
+
+  // calls handle(const io_uring_cqe&) for each completed request
+  template <class Handler>
+  void complete(Handler handle) {
+    unsigned head = *cqHead;
+    const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      handle(cqes[head & cqMask]);
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+  }
+
+private:
+  bool setup(unsigned entries, std::initializer_list<uint8_t> opcodes);
+
+  int fd = -1;
+  void* sqMap = nullptr;
+  size_t sqMapSize = 0;
+  void* cqMap = nullptr;
+  size_t cqMapSize = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqesSize = 0;
+
+  unsigned* sqHead = nullptr;
+  unsigned* sqTail = nullptr;
+  unsigned sqMask = 0;
+  unsigned sqEntries = 0;
+  unsigned* sqArray = nullptr;
+  // the tail including entries prepared but not submitted yet
+  unsigned sqLocalTail = 0;
+  unsigned* cqHead = nullptr;
+  unsigned* cqTail = nullptr;
+  unsigned cqMask = 0;
+  io_uring_cqe* cqes = nullptr;
+};
+
+#else
+
+// io_uring is linux only, elsewhere there is never a ring to use
+class IoRing {
+public:
+  bool valid() const { return false; }
+};
+
+#endif
+
+#endif /* IoRing_hpp */
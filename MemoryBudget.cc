@@ -0,0 +1,69 @@
+//
+//  MemoryBudget.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "MemoryBudget.hh"
+
+#include <algorithm>
+
+MemoryBudget::Reservation::Reservation(Reservation&& other) noexcept
+  : budget(other.budget)
+  , bytes(other.bytes)
+{
+  other.budget = nullptr;
+  other.bytes = 0;
+}
+
+MemoryBudget::Reservation& MemoryBudget::Reservation::operator=(Reservation&& other) noexcept {
+  if (this != &other) {
+    release();
+    budget = other.budget;
+    bytes = other.bytes;
+    other.budget = nullptr;
+    other.bytes = 0;
+  }
+  return *this;
+}
+
+void MemoryBudget::Reservation::release() {
+  if (budget != nullptr) {
+    budget->release(bytes);
+    budget = nullptr;
+    bytes = 0;
+  }
+}
+
+MemoryBudget::Reservation MemoryBudget::reserve(uint64_t bytes) {
+  // more than the budget is charged as all of it, which is granted once
+  // nothing else is reserved
+  const uint64_t charge = limit != 0 ? min(bytes, limit) : bytes;
+  {
+    unique_lock<mutex> lock(stateMutex);
+    const uint64_t ticket = nextTicket++;
+    changed.wait(lock, [&]() {
+      return ticket == serving && (limit == 0 || used + charge <= limit);
+    });
+    ++serving;
+    used += charge;
+    peakUsed = max(peakUsed, used);
+  }
+  // the next in line may fit as well
+  changed.notify_all();
+  return Reservation(this, charge);
+}
+
+void MemoryBudget::release(uint64_t bytes) {
+  {
+    lock_guard<mutex> lock(stateMutex);
+    used -= bytes;
+  }
+  changed.notify_all();
+}
+
+uint64_t MemoryBudget::peak() const {
+  lock_guard<mutex> lock(stateMutex);
+  return peakUsed;
+}
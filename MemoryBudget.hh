@@ -0,0 +1,76 @@
+//
+//  MemoryBudget.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef MemoryBudget_hpp
+#define MemoryBudget_hpp
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+using namespace std;
+
+/**
+ Bytes the image decodes may hold at once, so a burst of huge images waits
+ for memory instead of running the process out of it. A decode reserves its
+ estimated size before it starts and releases it when its image is gone.
+ Reservations are granted in the order they were asked for, so a large one
+ is not starved by a stream of small ones. One larger than the whole budget
+ waits until nothing else is reserved and then has the budget to itself.
+ A limit of 0 reserves without waiting, which still tracks the peak.
+ May be used from any number of threads.
+ */
+class MemoryBudget {
+public:
+  // bytes reserved until release or destruction
+  class Reservation {
+  public:
+    Reservation() = default;
+    Reservation(Reservation&& other) noexcept;
+    Reservation& operator=(Reservation&& other) noexcept;
+    ~Reservation() { release(); }
+
+    void release();
+
+  private:
+    friend class MemoryBudget;
+    Reservation(MemoryBudget* owner, uint64_t reserved) : budget(owner), bytes(reserved) {}
+
+    MemoryBudget* budget = nullptr;
+    uint64_t bytes = 0;
+  };
+
+  explicit MemoryBudget(uint64_t limitBytes) : limit(limitBytes) {}
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  // waits until bytes fit
+  Reservation reserve(uint64_t bytes);
+
+  // false for a limit of 0
+  bool limited() const { return limit != 0; }
+
+  // true if bytes are more than the whole budget
+  bool exceeds(uint64_t bytes) const { return limit != 0 && bytes > limit; }
+
+  // the most reserved at once so far
+  uint64_t peak() const;
+
+private:
+  void release(uint64_t bytes);
+
+  const uint64_t limit;
+  mutable mutex stateMutex;
+  condition_variable changed;
+  uint64_t used = 0;
+  uint64_t peakUsed = 0;
+  // the reservations asked for, and the one which is next to be granted
+  uint64_t nextTicket = 0;
+  uint64_t serving = 0;
+};
+
+#endif /* MemoryBudget_hpp */
@@ -0,0 +1,124 @@
+//
+//  ProgressReporter.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "ProgressReporter.hh"
+
+#include <cmath>
+#include <cstdio>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+double toSeconds(chrono::steady_clock::duration d) {
+  return chrono::duration<double>(d).count();
+}
+
+// 1h02m03s, 2m03s or 3s
+string formatDuration(double seconds) {
+  const auto total = static_cast<long long>(seconds + 0.5);
+  char buffer[64];
+  if (total >= 3600) {
+    snprintf(buffer, sizeof(buffer), "%lldh%02lldm%02llds", total / 3600, total / 60 % 60, total % 60);
+  } else if (total >= 60) {
+    snprintf(buffer, sizeof(buffer), "%lldm%02llds", total / 60, total % 60);
+  } else {
+    snprintf(buffer, sizeof(buffer), "%llds", total);
+  }
+  return buffer;
+}
+
+} // namespace
+
+ProgressReporter::ProgressReporter(const HashPipeline& pipeline, chrono::milliseconds interval, Format format, ostream& out)
+  : pipeline(pipeline)
+  , interval(interval)
+  , format(format)
+  , out(out)
+  , reporter([this]() { run(); })
+{}
+
+ProgressReporter::~ProgressReporter() {
+  {
+    lock_guard<mutex> lock(stateMutex);
+    stopping = true;
+  }
+  wakeup.notify_one();
+  if (reporter.joinable()) {
+    reporter.join();
+  }
+}
+
+void ProgressReporter::stop() {
+  {
+    lock_guard<mutex> lock(stateMutex);
+    stopping = true;
+    printFinal = true;
+  }
+  wakeup.notify_one();
+  reporter.join();
+}
+
+void ProgressReporter::run() {
+  const auto start = chrono::steady_clock::now();
+  auto previousTime = start;
+  HashPipeline::Progress previous;
+
+  unique_lock<mutex> lock(stateMutex);
+  while (!stopping) {
+    // woken early by stop
+    wakeup.wait_until(lock, previousTime + interval, [this]() { return stopping; });
+    if (stopping && !printFinal) {
+      break;
+    }
+
+    const auto now = chrono::steady_clock::now();
+    const auto progress = pipeline.progress();
+    lock.unlock();
+    report(progress, previous, now - start, now - previousTime);
+    lock.lock();
+    previous = progress;
+    previousTime = now;
+  }
+}
+
+void ProgressReporter::report(const HashPipeline::Progress& now, const HashPipeline::Progress& previous,
+                              chrono::steady_clock::duration sinceStart, chrono::steady_clock::duration sincePrevious) {
+  const double elapsed = max(toSeconds(sincePrevious), 1e-3);
+  const double filesPerSecond = static_cast<double>(now.done - previous.done) / elapsed;
+  const double megabytesPerSecond = static_cast<double>(now.bytesRead - previous.bytesRead) / 1e6 / elapsed;
+  const double hitRate = now.done > 0 ? static_cast<double>(now.cached) / static_cast<double>(now.done) : 0.0;
+
+  // from the average rate since the start, which moves less than the last
+  // interval's. negative if there is nothing to go by yet.
+  const double averageRate = static_cast<double>(now.done) / max(toSeconds(sinceStart), 1e-3);
+  const auto remaining = now.submitted > now.done ? now.submitted - now.done : 0;
+  const double eta = remaining == 0 ? 0.0 : averageRate > 0 ? static_cast<double>(remaining) / averageRate : -1.0;
+  const bool known = totalKnown;
+
+  if (format == Format::json) {
+    json line = {
+      {"elapsed_seconds", toSeconds(sinceStart)},
+      {"files_done", now.done},
+      {"files_total", now.submitted},
+      {"total_known", known},
+      {"files_per_second", filesPerSecond},
+      {"megabytes_per_second", megabytesPerSecond},
+      {"cache_hit_rate", hitRate},
+      {"eta_seconds", eta},
+    };
+    out << line.dump() << endl;
+    return;
+  }
+
+  out << "hashing: " << now.done << " of " << now.submitted << (known ? "" : "+") << " files, "
+      << lround(filesPerSecond) << " files/s, " << lround(megabytesPerSecond * 10) / 10.0 << " MB/s, "
+      << lround(hitRate * 100) << "% cached, eta " << (eta < 0 ? string("unknown") : (known ? "" : "over ") + formatDuration(eta))
+      << endl;
+}
@@ -0,0 +1,67 @@
+//
+//  ProgressReporter.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef ProgressReporter_hpp
+#define ProgressReporter_hpp
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+#include "HashPipeline.hh"
+
+using namespace std;
+
+/**
+ Prints how far the hashing got at a fixed interval, from a thread of its
+ own which samples the counters of the pipeline, so the workers do nothing
+ for it. Each line has the files done, the files and megabytes per second
+ since the previous line, the share of files found in the cache and an
+ estimate of the time left. While the walk is still finding files the
+ total is not known yet, and the estimate is for the files found so far.
+ As text the lines are meant for people, as json they are one object per
+ line for scripts.
+ */
+class ProgressReporter {
+public:
+  enum class Format { text, json };
+
+  // starts reporting on pipeline every interval
+  ProgressReporter(const HashPipeline& pipeline, chrono::milliseconds interval, Format format, ostream& out);
+  // stops without a final line, if stop was not called
+  ~ProgressReporter();
+  ProgressReporter(const ProgressReporter&) = delete;
+  ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+  // all files have been submitted to the pipeline
+  void setTotalKnown() { totalKnown = true; }
+
+  // stops reporting, after a final line
+  void stop();
+
+private:
+  void run();
+  void report(const HashPipeline::Progress& now, const HashPipeline::Progress& previous,
+              chrono::steady_clock::duration sinceStart, chrono::steady_clock::duration sincePrevious);
+
+  const HashPipeline& pipeline;
+  const chrono::milliseconds interval;
+  const Format format;
+  ostream& out;
+  atomic<bool> totalKnown{false};
+
+  mutex stateMutex;
+  condition_variable wakeup;
+  bool stopping = false;
+  bool printFinal = false;
+  thread reporter;
+};
+
+#endif /* ProgressReporter_hpp */
@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <fstream>  //for file writing
 #include <iostream> //for cerr
@@ -18,113 +19,136 @@
 #include <string>   //for easier passing of string arguments
 #include <thread>   //sleep
 #include <future>
+#include <mutex>
+#include <numeric>
 
 // project
-#include "Fileinfo.hh" //file container
+#include "FileTable.hh" //file container
 #include "RdfindDebug.hh"
 
 // class declaration
 #include "Rdutil.hh"
+#include "HammingDistance.hh"
+#include "HashIndex.hh"
+#include "ImageReader.hh"
 #include "Tools.hh"
+#include "UnionFind.hh"
 
 using namespace std;
 using namespace cv;
-using namespace cv::img_hash;
 using namespace cv::ml;
 
-void Rdutil::sortClustersBySize() {
-  sort(clusters.begin(), clusters.end(), [](const Cluster& c1, const Cluster& c2) {
-      auto c2s = c2.size();
-      auto c1s = c1.size();
-      return ((c2s < c1s) || (c2s == c1s && c2.distance < c1.distance));
+namespace {
+
+  // largest clusters first, the most distant first among those of one size,
+  // and the one found first among those of one size and distance, so the
+  // order does not depend on the sort
+  bool isBefore(const FileTable& table, const Cluster& c1, const Cluster& c2) {
+    if (c1.size() != c2.size()) {
+      return c2.size() < c1.size();
     }
-  );
-}
+    if (c1.getDistance() != c2.getDistance()) {
+      return c2.getDistance() < c1.getDistance();
+    }
+    return table.identity(c1.getFiles().front()) < table.identity(c2.getFiles().front());
+  }
+
+} // namespace
 
-int Rdutil::printtofile(const string& filename) {
-  // open a file to print to
-  ofstream f1;
-  f1.open(filename.c_str(), ios_base::out);
-  if (!f1.is_open()) {
+int Rdutil::printtofile(const string& filename, ResultWriter::Format format) {
+  ResultWriter writer(m_table, filename, format);
+  if (!writer.isOpen()) {
     cerr << "could not open file \"" << filename << "\"\n";
     return -1;
   }
 
-  // exchange f1 for cout to write to terminal instead of file
-  ostream& output(f1);
-
-  for (auto& c : clusters) {
-    output << "# Section (size:" << c.size() << ", distance:" << c.getDistance() << ')' << '\n';
-    int n = 0;
-    for (auto& f : c.filesSortedBySize()) {
-      output << n << ":" << f.get()->size() << ' ' << f.get()->name() << '\n';
-      ++n;
-    }
+  // a heap sort, which settles the place of the first cluster, then of the
+  // next and so on, each goes to the writer thread as soon as it is known.
+  // the heap puts them at the back, later heap steps do not touch them.
+  auto after = [this](const Cluster& c1, const Cluster& c2) { return isBefore(m_table, c2, c1); };
+  auto end = clusters.end();
+  make_heap(clusters.begin(), end, after);
+  while (end != clusters.begin()) {
+    pop_heap(clusters.begin(), end, after);
+    --end;
+    writer.write(*end);
+  }
+  const bool written = writer.finish();
+  // first to last, now that the writer is done with them
+  reverse(clusters.begin(), clusters.end());
+  if (!written) {
+    cerr << "could not write file \"" << filename << "\"\n";
+    return -1;
   }
 
   if (!pathClusters.empty()) {
+    if (format != ResultWriter::Format::text) {
+      cout << "The sorting suggestions are only written to a text results file." << endl;
+      return 0;
+    }
+
+    ofstream output(filename.c_str(), ios_base::out | ios_base::app);
+    if (!output.is_open()) {
+      cerr << "could not open file \"" << filename << "\"\n";
+      return -1;
+    }
     output << "\n\n### Sorting ###\n\n";
     //calcClusterSortSuggestions(output);
     
     buildTrainData(output);
   }
 
-  f1.close();
   return 0;
 }
 
 // mark files with a unique number
 void Rdutil::markitems() {
   int64_t fileno = 1;
-  for (auto& file : m_list) {
-    file.get()->setidentity(fileno++);
+  for (auto file : m_list) {
+    m_table.setIdentity(file, fileno++);
   }
 }
 
 namespace {
 
-  bool cmpDeviceInode(const Ptr<Fileinfo>& a, const Ptr<Fileinfo>& b) {
-    return make_tuple(a.get()->device(), a.get()->inode()) <
-           make_tuple(b.get()->device(), b.get()->inode());
-  }
-
-  // compares rank as described in RANKING on man page.
-  bool cmpRank(const Ptr<Fileinfo>& a, const Ptr<Fileinfo>& b) {
-    return make_tuple(a.get()->get_cmdline_index(), a.get()->depth(), a.get()->getidentity()) <
-           make_tuple(b.get()->get_cmdline_index(), b.get()->depth(), b.get()->getidentity());
-  }
-
-  bool cmpDepthName(const Ptr<Fileinfo>& a, const Ptr<Fileinfo>& b) {
-    // inefficient, make it a reference.
-    return make_tuple(a.get()->depth(), a.get()->name()) <
-           make_tuple(b.get()->depth(), b.get()->name());
-  }
-
-  /**
-   * goes through first to last, finds ranges of equal elements (determined by
-   * cmp) and invokes callback on each subrange.
-   * @param callback invoked as callback(subrangefirst,subrangelast)
-   */
-  template<class Iterator, class Cmp, class Callback>
-  void apply_on_range(Iterator first, Iterator last, Cmp cmp, Callback callback) {
-    assert(is_sorted(first, last, cmp));
-
-    while (first != last) {
-      auto sublast = first + 1;
-      while (sublast != last && !cmp(*first, *sublast)) {
-        ++sublast;
-      }
-      // a duplicate range with respect to cmp
-      callback(first, sublast);
+  // the columns a sort looks at, gathered next to the row so the sort moves
+  // small contiguous records instead of chasing rows in the table
+  struct InodeKey {
+    uint64_t device;
+    uint64_t inode;
+    // rank as described in RANKING on man page
+    int cmdlineIndex;
+    int depth;
+    int64_t identity;
+    FileTable::Id file;
+
+    bool operator<(const InodeKey& other) const {
+      return make_tuple(device, inode, cmdlineIndex, depth, identity) <
+             make_tuple(other.device, other.inode, other.cmdlineIndex, other.depth, other.identity);
+    }
 
-      // keep searching.
-      first = sublast;
+    bool sameInode(const InodeKey& other) const {
+      return device == other.device && inode == other.inode;
+    }
+  };
+
+  vector<InodeKey> inodeKeys(const FileTable& table, const vector<FileTable::Id>& list) {
+    vector<InodeKey> keys;
+    keys.reserve(list.size());
+    for (auto f : list) {
+      keys.push_back({table.device(f), table.inode(f), table.cmdlineIndex(f),
+                      table.depth(f), table.identity(f), f});
     }
+    return keys;
   }
 } // namespace
 
 int Rdutil::sortOnDeviceAndInode() {
-  sort(m_list.begin(), m_list.end(), cmpDeviceInode);
+  auto keys = inodeKeys(m_table, m_list);
+  sort(keys.begin(), keys.end());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    m_list[i] = keys[i].file;
+  }
   return 0;
 }
 
@@ -132,52 +156,40 @@ void Rdutil::sort_on_depth_and_name(size_t index_of_first) {
   assert(index_of_first <= m_list.size());
 
   auto it = begin(m_list) + static_cast<ptrdiff_t>(index_of_first);
-  sort(it, end(m_list), cmpDepthName);
+  const FileTable::PathOrder byName(m_table);
+  sort(it, end(m_list), [this, &byName](FileTable::Id a, FileTable::Id b) {
+    const auto depthA = m_table.depth(a);
+    const auto depthB = m_table.depth(b);
+    if (depthA != depthB) {
+      return depthA < depthB;
+    }
+    return byName(a, b);
+  });
 }
 
 size_t Rdutil::removeIdenticalInodes() {
   auto initialSize = m_list.size();
 
-  // sort list on device and inode.
-  auto cmp = cmpDeviceInode;
-  sort(m_list.begin(), m_list.end(), cmp);
-  
-  auto filesToRemove = set<int64_t>();
-
-  // loop over ranges of adjacent elements
-  using Iterator = decltype(m_list.begin());
-  apply_on_range(
-    m_list.begin(), m_list.end(), cmp, [&filesToRemove](Iterator first, Iterator last) {
-      // let the highest-ranking element not be deleted. do this in order, to be
-      // cache friendly.
-      auto best = min_element(first, last, cmpRank);
-      for_each(first, best, [&filesToRemove](Ptr<Fileinfo>& f) mutable {
-        filesToRemove.insert(f.get()->getidentity());
-      });
-      
-      filesToRemove.erase(best->get()->getidentity());
-      
-      for_each(best + 1, last, [&filesToRemove](Ptr<Fileinfo>& f) mutable {
-        filesToRemove.insert(f.get()->getidentity());
-      });
-    });
+  // sort on device and inode, and on rank within them, so the
+  // highest-ranking file of each group of identical inodes comes first
+  auto keys = inodeKeys(m_table, m_list);
+  sort(keys.begin(), keys.end());
 
-  auto it = remove_if(
-    m_list.begin(), m_list.end(), [&filesToRemove](Ptr<Fileinfo>& f) {
-        return filesToRemove.find(f.get()->getidentity()) != filesToRemove.end();
+  m_list.clear();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (i == 0 || !keys[i].sameInode(keys[i - 1])) {
+      m_list.push_back(keys[i].file);
     }
-  );
-    
-  m_list.erase(it, m_list.end());
-    
+  }
+
   return initialSize - m_list.size();
 }
 
 size_t Rdutil::removeNonImages() {
     auto initialSize = m_list.size();
     auto it = remove_if(
-        m_list.begin(), m_list.end(), [](Ptr<Fileinfo>& f) {
-            return !f.get()->isImage();
+        m_list.begin(), m_list.end(), [this](FileTable::Id f) {
+            return !m_table.isImage(f);
         }
     );
     
@@ -205,10 +217,10 @@ size_t Rdutil::removeInvalidImages() {
   return removeInvalidImages(m_list);
 }
 
-size_t Rdutil::removeInvalidImages(vector<Ptr<Fileinfo>>& files) {
+size_t Rdutil::removeInvalidImages(vector<FileTable::Id>& files) {
   const auto size_before = files.size();
-  auto it = remove_if(files.begin(), files.end(), [](const Ptr<Fileinfo>& f) {
-    return f.get()->isInvalidImage();
+  auto it = remove_if(files.begin(), files.end(), [this](FileTable::Id f) {
+    return m_table.isInvalidImage(f);
   });
 
   files.erase(it, files.end());
@@ -218,11 +230,11 @@ size_t Rdutil::removeInvalidImages(vector<Ptr<Fileinfo>>& files) {
   return size_before - size_after;
 }
 
-Fileinfo::filesizetype Rdutil::totalsizeinbytes() const
+FileTable::filesizetype Rdutil::totalsizeinbytes() const
 {
-  Fileinfo::filesizetype totalsize = 0;
-  for (const auto& elem : m_list) {
-    totalsize += elem.get()->size();
+  FileTable::filesizetype totalsize = 0;
+  for (auto elem : m_list) {
+    totalsize += m_table.fileSize(elem);
   }
 
   return totalsize;
@@ -230,9 +242,9 @@ Fileinfo::filesizetype Rdutil::totalsizeinbytes() const
 
 namespace littlehelper {
   // helper to make "size" into a more readable form.
-  int calcrange(Fileinfo::filesizetype& size) {
+  int calcrange(FileTable::filesizetype& size) {
     int range = 0;
-    Fileinfo::filesizetype tmp = 0;
+    FileTable::filesizetype tmp = 0;
     while (size > 1024) {
       tmp = size >> 9;
       size = (tmp >> 1);
@@ -279,7 +291,7 @@ ostream& Rdutil::totalsize(ostream& out) const {
 }
 
 ostream& Rdutil::saveablespace(ostream& out) const {
-  Fileinfo::filesizetype size = 0;
+  FileTable::filesizetype size = 0;
   for (auto& c : clusters) {
     size += c.fileSizeWithoutBiggest();
   }
@@ -289,72 +301,237 @@ ostream& Rdutil::saveablespace(ostream& out) const {
   return out;
 }
 
-class CalcHashesThread {
-    vector<Ptr<Fileinfo>>::iterator begin;
-    vector<Ptr<Fileinfo>>::iterator end;
-
-public:
-    CalcHashesThread(
-      vector<Ptr<Fileinfo>>::iterator b,
-      vector<Ptr<Fileinfo>>::iterator e
-    ) {
-        begin = b;
-        end = e;
-    }
-    
-    void operator()(){
-        for_each(begin, end, [this](Ptr<Fileinfo>& f) {
-            f.get()->calcHashes();
-        });
-    }
-};
-
-void Rdutil::calcHashes() {
-  calcHashes(m_list);
+void Rdutil::calcHashes(MemoryBudget& budget) {
+  calcHashes(m_list, budget);
 }
 
-void Rdutil::calcHashes(vector<Ptr<Fileinfo>>& files) {
-  auto threads = runInParallel(
-    files,
-    [](vector<Ptr<Fileinfo>>::iterator begin, vector<Ptr<Fileinfo>>::iterator end) {
-      return CalcHashesThread(
-         begin,
-         end
-      );
-    }
-  );
-
-  for_each(threads.begin(), threads.end(), mem_fn(&thread::join));
+void Rdutil::calcHashes(vector<FileTable::Id>& files, MemoryBudget& budget) {
+  runInParallel(m_pool, files, [this, &budget](FileTable::Id& f) {
+    m_table.calcHashes(f, budget);
+  });
 }
 
 void Rdutil::buildClusters() {
-//  for_each(m_list.begin(), m_list.end(), [this](const Fileinfo& f) {
-//
-//
-//
-//  });
+  // a cluster accepts a file only if all members are close to it, so only
+  // clusters with a member sharing a pHash block with the file are checked.
+  // candidates come back in cluster order, which keeps the first match the same
+  // as scanning every cluster.
+  HashIndex index(static_cast<int>(Cluster::maxDistance));
+  vector<uint32_t> candidates;
 
-  Ptr<ImgHashBase> aHashPtr = AverageHash::create();
-  Ptr<ImgHashBase> pHashPtr = PHash::create();
+  for (auto lf : m_list) {
+    const auto pHash = m_table.pHash(lf);
+    index.find(pHash, candidates);
 
-  for (auto& lf : m_list) {
     double distance = 0.0;
-    auto clusterToAddIn = find_if(clusters.begin(), clusters.end(), [&lf, &distance](Cluster& c) mutable {
-      return c.needAdd(lf, distance);
+    auto candidate = find_if(candidates.begin(), candidates.end(), [this, lf, &distance](uint32_t i) mutable {
+      return clusters[i].needAdd(lf, distance);
     });
-    
-    if (clusterToAddIn != clusters.end()) {
-      clusterToAddIn->setDistance(distance);
-      clusterToAddIn->add(lf);
+
+    uint32_t clusterIndex = 0;
+    if (candidate != candidates.end()) {
+      clusterIndex = *candidate;
+      clusters[clusterIndex].setDistance(distance);
+      clusters[clusterIndex].add(lf);
     } else {
+      clusterIndex = static_cast<uint32_t>(clusters.size());
       clusters.emplace_back(
+        m_table,
         "",
-        vector<Ptr<Fileinfo>>({lf}),
-        aHashPtr,
-        pHashPtr,
+        vector<FileTable::Id>({lf}),
         0.0
       );
     }
+
+    index.insert(pHash, clusterIndex);
+  }
+}
+
+namespace {
+
+// the order the order independent engines number files in
+vector<FileTable::Id> sortedOnName(const FileTable& table, const vector<FileTable::Id>& list) {
+  vector<FileTable::Id> files = list;
+  sort(files.begin(), files.end(), FileTable::PathOrder(table));
+  return files;
+}
+
+// the hashes of files, in the same order, for the pairwise scans
+struct HashColumns {
+  vector<uint64_t> aHashes;
+  vector<uint64_t> pHashes;
+
+  HashColumns(const FileTable& table, const vector<FileTable::Id>& files) {
+    aHashes.reserve(files.size());
+    pHashes.reserve(files.size());
+    for (auto f : files) {
+      aHashes.push_back(table.aHash(f));
+      pHashes.push_back(table.pHash(f));
+    }
+  }
+
+  bool isClose(uint32_t a, uint32_t b) const {
+    const int limit = static_cast<int>(Cluster::maxDistance);
+    return __builtin_popcountll(pHashes[a] ^ pHashes[b]) <= limit &&
+           __builtin_popcountll(aHashes[a] ^ aHashes[b]) <= limit;
+  }
+};
+
+} // namespace
+
+void Rdutil::buildClustersUnionFind() {
+  // every pair of files within the distance is joined, and a set of files
+  // has one set of pairs, so the clusters do not depend on the order files
+  // are compared in. files are numbered by name, not by the order they were
+  // found in, so the cluster and file order is reproducible as well.
+  const vector<FileTable::Id> files = sortedOnName(m_table, m_list);
+  const HashColumns hashes(m_table, files);
+
+  HashIndex index(static_cast<int>(Cluster::maxDistance));
+  for (size_t i = 0; i < files.size(); ++i) {
+    index.insert(hashes.pHashes[i], static_cast<uint32_t>(i));
+  }
+
+  UnionFind sets(files.size());
+  vector<uint32_t> ids(files.size());
+  iota(ids.begin(), ids.end(), 0);
+  runInParallel(m_pool, ids, [&hashes, &index, &sets](uint32_t& i) {
+    vector<uint32_t> candidates;
+    index.find(hashes.pHashes[i], candidates);
+    // each pair is checked from its smaller id only
+    for (auto j = upper_bound(candidates.begin(), candidates.end(), i); j != candidates.end(); ++j) {
+      if (hashes.isClose(i, *j)) {
+        sets.unite(i, *j);
+      }
+    }
+  });
+
+  clustersFromSets(files, sets);
+}
+
+void Rdutil::buildClustersSharded() {
+  // two pHashes within the distance are equal on at least one of
+  // maxDistance + 1 bit blocks. one shard gets all files with some value on
+  // some block, so every close pair meets in a shard and is joined there.
+  // shards share nothing until their joins are merged, which gives the
+  // clusters of buildClustersUnionFind.
+  const vector<FileTable::Id> files = sortedOnName(m_table, m_list);
+  const HashColumns hashes(m_table, files);
+  const int blockCount = static_cast<int>(Cluster::maxDistance) + 1;
+  auto blockValue = [blockCount](uint64_t hash, int block) {
+    const int begin = block * 64 / blockCount;
+    const int width = (block + 1) * 64 / blockCount - begin;
+    const uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    return (hash >> begin) & mask;
+  };
+
+  struct Shard {
+    // block value and file id, each run of one value is compared pairwise
+    vector<pair<uint64_t, uint32_t>> members;
+    int block = 0;
+    // file id and the id it is joined to
+    vector<pair<uint32_t, uint32_t>> joins;
+  };
+
+  // a few shards per block and thread, so a shard with a popular block value
+  // does not keep the others waiting
+  const size_t shardsPerBlock = 4 * m_pool.threadCount();
+  vector<Shard> shards(static_cast<size_t>(blockCount) * shardsPerBlock);
+  for (int block = 0; block < blockCount; ++block) {
+    for (size_t s = 0; s < shardsPerBlock; ++s) {
+      shards[static_cast<size_t>(block) * shardsPerBlock + s].block = block;
+    }
+  }
+  for (uint32_t i = 0; i < files.size(); ++i) {
+    const auto pHash = hashes.pHashes[i];
+    for (int block = 0; block < blockCount; ++block) {
+      const auto value = blockValue(pHash, block);
+      const size_t s = static_cast<size_t>(block) * shardsPerBlock + hash<uint64_t>()(value) % shardsPerBlock;
+      shards[s].members.emplace_back(value, i);
+    }
+  }
+
+  runInParallel(m_pool, shards, [&hashes, &blockValue](Shard& shard) {
+    auto& members = shard.members;
+    sort(members.begin(), members.end());
+
+    // joins within the shard, each file is linked to the first file of its
+    // set in the shard
+    vector<uint32_t> firstOf(members.size());
+    iota(firstOf.begin(), firstOf.end(), 0);
+    auto root = [&firstOf](uint32_t m) {
+      while (firstOf[m] != m) {
+        m = firstOf[m] = firstOf[firstOf[m]];
+      }
+      return m;
+    };
+
+    for (size_t begin = 0, end = 0; begin < members.size(); begin = end) {
+      for (end = begin + 1; end < members.size() && members[end].first == members[begin].first; ++end) {
+      }
+
+      for (size_t m = begin; m < end; ++m) {
+        const auto file = members[m].second;
+        const auto pHash = hashes.pHashes[file];
+        for (size_t n = m + 1; n < end; ++n) {
+          const auto other = members[n].second;
+          // a pair equal on an earlier block was compared in that block's shard
+          const auto otherPHash = hashes.pHashes[other];
+          bool earlier = false;
+          for (int block = 0; block < shard.block && !earlier; ++block) {
+            earlier = blockValue(pHash, block) == blockValue(otherPHash, block);
+          }
+          if (earlier || !hashes.isClose(file, other)) {
+            continue;
+          }
+
+          const auto a = root(static_cast<uint32_t>(m));
+          const auto b = root(static_cast<uint32_t>(n));
+          if (a != b) {
+            firstOf[max(a, b)] = min(a, b);
+          }
+        }
+      }
+    }
+
+    for (uint32_t m = 0; m < members.size(); ++m) {
+      const auto r = root(m);
+      if (r != m) {
+        shard.joins.emplace_back(members[m].second, members[r].second);
+      }
+    }
+  });
+
+  // the merge, joins spanning shards end up in one set here
+  UnionFind sets(files.size());
+  for (auto& shard : shards) {
+    for (auto& join : shard.joins) {
+      sets.unite(join.first, join.second);
+    }
+  }
+
+  clustersFromSets(files, sets);
+}
+
+void Rdutil::clustersFromSets(const vector<FileTable::Id>& files, UnionFind& sets) {
+  // the root of a set is its first file, so clusters come out in the order of
+  // their first file's name
+  clusters.clear();
+  vector<size_t> clusterOfRoot(files.size(), SIZE_MAX);
+  for (uint32_t i = 0; i < files.size(); ++i) {
+    const auto root = sets.find(i);
+    if (clusterOfRoot[root] == SIZE_MAX) {
+      clusterOfRoot[root] = clusters.size();
+      clusters.emplace_back(m_table, "", vector<FileTable::Id>({files[i]}), 0.0);
+      continue;
+    }
+
+    // the largest distance within the cluster, as reported for the greedy one
+    auto& cluster = clusters[clusterOfRoot[root]];
+    double distance = 0.0;
+    cluster.calcDistance(files[i], distance);
+    cluster.setDistance(max(cluster.getDistance(), distance));
+    cluster.add(files[i]);
   }
 }
 
@@ -381,44 +558,50 @@ static bool startsWith(const string_view& str, const string_view& prefix) {
     return str.size() >= prefix.size() && 0 == str.compare(0, prefix.size(), prefix);
 }
 
-void Rdutil::buildPathClusters(const char* path, const char* excludePath, Dirlist& dirlist, Cache& cache) {
-  Ptr<ImgHashBase> aHashPtr = AverageHash::create();
-  Ptr<ImgHashBase> pHashPtr = PHash::create();
-  vector<Ptr<Fileinfo>> files;
+void Rdutil::buildPathClusters(const char* path, const char* excludePath, Dirlist& dirlist, MemoryBudget& budget) {
+  vector<FileTable::Id> files;
   string excludePathString(excludePath);
+  mutex filesMutex;
 
-  dirlist.setcallbackfcn([this, &excludePathString, &aHashPtr, &pHashPtr, &cache, &files](const string& path, const string& name, int depth) {
+  dirlist.walk({string(path)}, [this, &excludePathString, &files, &filesMutex](size_t, const DirlistPosition&, const string& path, int depth, vector<DirlistEntry>& entries) {
     if (excludePathString.length() > 0 && startsWith(path, excludePathString)) {
-      return 0;
+      return;
     }
-  
-    string expandedname = path.empty() ? name : (path + "/" + name);
-    Ptr<Fileinfo> f = make_shared<Fileinfo>(expandedname, 0, depth, &cache);
-    if (f.get()->isImage()) {
-      files.push_back(f);
-      
-      auto entry = pathClusters.find(path);
-      if (entry == pathClusters.end()) {
-        pathClusters.emplace(
-          path,
-          Cluster(
-            path,
-            vector<Ptr<Fileinfo>>({f}),
-            aHashPtr,
-            pHashPtr,
-            0.0
-          )
-        );
-      } else {
-        entry->second.add(f);
+
+    vector<FileTable::Id> images;
+    FileTable::DirId dir = FileTable::rootDirectory;
+    for (auto& entry : entries) {
+      if (!hasImageExtension(entry.name)) {
+        continue;
+      }
+      if (images.empty()) {
+        dir = m_table.addDirectory(path);
+      }
+      // the stat is needed to validate the cached hashes
+      images.push_back(m_table.add(dir, entry.name, 0, depth, entry.info));
+    }
+    if (images.empty()) {
+      return;
+    }
+
+    lock_guard<mutex> lock(filesMutex);
+    files.insert(files.end(), images.begin(), images.end());
+
+    auto cluster = pathClusters.find(path);
+    if (cluster == pathClusters.end()) {
+      pathClusters.emplace(path, Cluster(m_table, path, images, 0.0));
+    } else {
+      for (auto f : images) {
+        cluster->second.add(f);
       }
     }
-    
-    return 0;
   });
 
-  dirlist.walk(string(path));
-  calcHashes(files);
+  calcHashes(files, budget);
+
+  for (auto& entry : pathClusters) {
+    entry.second.refreshHashes();
+  }
 }
 
 const int WIDTH_SIZE = 50;
@@ -459,10 +642,11 @@ void Rdutil::buildTrainData(ostream& out) {
   out << '\n';
   
   int i = 0;
+  string path;
   for (auto& cl : pathClusters) {
-    for (auto& f : cl.second.files) {
+    for (auto f : cl.second.files) {
       Mat im;
-      if (!f.get()->isInvalidImage() && loadMLImage(f.get()->name(), im)) {
+      if (!m_table.isInvalidImage(f) && loadMLImage(m_table.path(f, path), im)) {
         Mat signImageDataInOneRow = im.reshape(0, 1);
         inputTrainingData.push_back(signImageDataInOneRow);
         
@@ -524,12 +708,12 @@ void Rdutil::buildTrainData(ostream& out) {
     mlp->save("./mlpfile");
   }
 
-  for (auto& f : m_list) {
+  for (auto f : m_list) {
     Mat img;
     Mat result;
     //mlp->predict(inputTrainingData.row(i), result);
-    if (loadMLImage(f.get()->name(), img)) {
-      out << f.get()->name() << '\n';
+    if (loadMLImage(m_table.path(f, path), img)) {
+      out << path << '\n';
       mlp->predict(img.reshape(0, 1), result);
       //out << result << endl;
       for (int c=0; c<result.cols; ++c) {
@@ -565,31 +749,30 @@ struct ClusterSuggestions {
 };
 
 void Rdutil::calcClusterSortSuggestions(ostream& out) {
+  string path;
   for (auto& c : clusters) {
     out << "Sorting cluster(size:" << c.size() << ", distance:" << c.distance << " with:" << "\n";
-    for (auto& f : c.files) { out << "  " << f.get()->name() << endl; }
+    for (auto f : c.files) { out << "  " << m_table.path(f, path) << endl; }
     out << "to" << endl;
     
     ClusterSuggestions suggestions;
+    vector<uint8_t> distances;
   
     for (auto& pathC : pathClusters) {
       double minDistance = numeric_limits<double>::max();
       double maxDistance = 0;
-      for (auto& f : c.files) {
+      const auto& pHashes = pathC.second.getPHashes();
+      distances.resize(pHashes.size());
+
+      for (auto f : c.files) {
         
-        if (f.get()->isInvalidImage()) {
+        if (m_table.isInvalidImage(f)) {
           continue;
         }
 
-        for (auto& cf : pathC.second.files) {
-          if (cf.get()->isInvalidImage()) {
-            continue;
-          }
-        
-          //auto aDistance = c.getAHashPtr()->compare(f.get()->getAHash(), cf.get()->getAHash());
-          auto pDistance = c.getPHashPtr()->compare(f.get()->getPHash(), cf.get()->getPHash());
-        
-          double d = pDistance; //fmax(aDistance, pDistance);
+        hammingDistances(m_table.pHash(f), pHashes.data(), pHashes.size(), distances.data());
+
+        for (auto d : distances) {
           minDistance = fmin(minDistance, d);
           maxDistance = fmax(maxDistance, d);
         }
@@ -14,24 +14,33 @@
 #include <opencv2/img_hash.hpp>
 #include <opencv2/ml/ml.hpp>
 
-#include "Fileinfo.hh" //file container
+#include "FileTable.hh" //file container
 #include "Cluster.hh"
 #include "Dirlist.hh"
+#include "MemoryBudget.hh"
+#include "ResultWriter.hh"
+#include "ThreadPool.hh"
+#include "UnionFind.hh"
 
 using namespace std;
 
 class Rdutil
 {
 public:
-  explicit Rdutil(vector<Ptr<Fileinfo>>& list)
-    : m_list(list)
+  // list holds the rows of table which are worked on
+  Rdutil(FileTable& table, vector<FileTable::Id>& list, ThreadPool& pool)
+    : m_table(table)
+    , m_list(list)
+    , m_pool(pool)
   {}
 
   /**
-   * print file names to a file, with extra information.
+   * sorts the clusters largest first and prints their file names to a file
+   * in format, with extra information. each cluster is written as soon as
+   * its place is known, while the rest are sorted.
    * @return zero on success
    */
-  int printtofile(const string& filename);
+  int printtofile(const string& filename, ResultWriter::Format format);
 
   /// mark files with a unique number
   void markitems();
@@ -66,24 +75,36 @@ public:
    */
   
   size_t removeInvalidImages();
-  size_t removeInvalidImages(vector<Ptr<Fileinfo>>& files);
+  size_t removeInvalidImages(vector<FileTable::Id>& files);
 
   /// removes all items from the list, that have the deleteflag set to true.
   size_t cleanup();
   
-  void calcHashes();
-  void calcHashes(vector<Ptr<Fileinfo>>& files);
+  // decodes within budget what is not in the cache
+  void calcHashes(MemoryBudget& budget);
+  void calcHashes(vector<FileTable::Id>& files, MemoryBudget& budget);
   
   long readyToCleanup();
   
   void buildClusters();
-  void sortClustersBySize();
+  /**
+   * joins every two files within Cluster::maxDistance of each other into one
+   * cluster, transitively. unlike buildClusters the result does not depend on
+   * the order of the files, and the comparisons run in parallel.
+   */
+  void buildClustersUnionFind();
+  /**
+   * gives the clusters of buildClustersUnionFind, from shards of the files
+   * which are clustered on their own and merged afterwards. the shards do not
+   * share any state while clustering, so this scales with the cores.
+   */
+  void buildClustersSharded();
 
   /**
    * gets the total size, in bytes.
    * m_duptype=Fileinfo::DUPTYPE_FIRST_OCCURRENCE
    */
-  [[gnu::pure]] Fileinfo::filesizetype totalsizeinbytes() const;
+  [[gnu::pure]] FileTable::filesizetype totalsizeinbytes() const;
 
   /**
    * outputs a nicely formatted string "45 bytes" or "3 Gibytes"
@@ -99,12 +120,18 @@ public:
   size_t removeSingleClusters();
   size_t clusterFileCount();
   
-  void buildPathClusters(const char* path, const char* excludePath, Dirlist& dirlist, Cache& cache);
+  void buildPathClusters(const char* path, const char* excludePath, Dirlist& dirlist, MemoryBudget& budget);
   void calcClusterSortSuggestions(ostream& out);
   void buildTrainData(ostream& out);
 
 private:
-    vector<Ptr<Fileinfo>>& m_list;
+    // turns the sets of files into clusters, the files numbered as in sets
+    void clustersFromSets(const vector<FileTable::Id>& files, UnionFind& sets);
+
+    FileTable& m_table;
+    vector<FileTable::Id>& m_list;
+    // runs the parallel stages
+    ThreadPool& m_pool;
     map<string, Cluster> pathClusters;
     vector<Cluster> clusters;
     
@@ -0,0 +1,211 @@
+//
+//  ResultWriter.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "ResultWriter.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// the buffer goes to the file once it is this large
+constexpr size_t flushSize = 1 << 20;
+// clusters handed over but not written yet
+constexpr size_t queueCapacity = 4096;
+
+void appendNumber(string& out, uint64_t value) {
+  char digits[24];
+  const int length = snprintf(digits, sizeof(digits), "%llu", static_cast<unsigned long long>(value));
+  out.append(digits, static_cast<size_t>(length));
+}
+
+// format is "%g" for what an ostream prints by default, "%.17g" to read
+// back the same double
+void appendDistance(string& out, double distance, const char* format) {
+  char digits[32];
+  const int length = snprintf(digits, sizeof(digits), format, distance);
+  out.append(digits, static_cast<size_t>(length));
+}
+
+void appendJsonString(string& out, const string& text) {
+  out += '"';
+  for (const char c : text) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+        out += escaped;
+      } else {
+        out += c;
+      }
+    }
+  }
+  out += '"';
+}
+
+template <class T>
+void appendLittleEndian(string& out, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    out += static_cast<char>(static_cast<uint64_t>(value) >> (8 * i));
+  }
+}
+
+void appendBinaryDistance(string& out, double distance) {
+  uint64_t bits;
+  static_assert(sizeof(bits) == sizeof(distance), "distance must be a 64 bit double");
+  memcpy(&bits, &distance, sizeof(bits));
+  appendLittleEndian(out, bits);
+}
+
+} // namespace
+
+ResultWriter::ResultWriter(const FileTable& table, const string& filename, Format format)
+  : table(table)
+  , format(format)
+  , queue(queueCapacity)
+{
+  // the buffer is written a megabyte at a time, without copying it into
+  // the one of the stream first
+  out.rdbuf()->pubsetbuf(nullptr, 0);
+  out.open(filename, ios_base::out | ios_base::trunc | ios_base::binary);
+  if (!out.is_open()) {
+    return;
+  }
+  buffer.reserve(flushSize + flushSize / 4);
+  if (format == Format::binary) {
+    buffer += "RDFC";
+    appendLittleEndian(buffer, binaryVersion);
+  }
+  writer = thread([this]() { run(); });
+}
+
+ResultWriter::~ResultWriter() {
+  finish();
+}
+
+void ResultWriter::write(const Cluster& cluster) {
+  if (isOpen()) {
+    queue.push(&cluster);
+  }
+}
+
+bool ResultWriter::finish() {
+  if (!isOpen()) {
+    return false;
+  }
+  queue.close();
+  writer.join();
+  out.close();
+  return !failed && !out.fail();
+}
+
+void ResultWriter::run() {
+  const Cluster* cluster = nullptr;
+  while (queue.pop(cluster)) {
+    append(*cluster);
+    if (buffer.size() >= flushSize) {
+      flush();
+    }
+  }
+  flush();
+}
+
+void ResultWriter::append(const Cluster& cluster) {
+  // the sizes are looked up once instead of at every comparison
+  const auto& files = cluster.getFiles();
+  bySize.clear();
+  for (auto f : files) {
+    bySize.emplace_back(table.fileSize(f), f);
+  }
+  // files of one size in the order of their ids, so the output does not
+  // depend on the sort
+  sort(bySize.begin(), bySize.end(), [](const auto& a, const auto& b) {
+    return a.first != b.first ? b.first < a.first : a.second < b.second;
+  });
+
+  switch (format) {
+  case Format::text: {
+    buffer += "# Section (size:";
+    appendNumber(buffer, files.size());
+    buffer += ", distance:";
+    appendDistance(buffer, cluster.getDistance(), "%g");
+    buffer += ")\n";
+    uint64_t n = 0;
+    for (auto& file : bySize) {
+      appendNumber(buffer, n++);
+      buffer += ':';
+      appendNumber(buffer, static_cast<uint64_t>(file.first));
+      buffer += ' ';
+      buffer += table.path(file.second, path);
+      buffer += '\n';
+    }
+    break;
+  }
+  case Format::jsonl: {
+    buffer += "{\"size\":";
+    appendNumber(buffer, files.size());
+    buffer += ",\"distance\":";
+    // json has no infinity or nan
+    if (isfinite(cluster.getDistance())) {
+      appendDistance(buffer, cluster.getDistance(), "%.17g");
+    } else {
+      buffer += "null";
+    }
+    buffer += ",\"files\":[";
+    bool first = true;
+    for (auto& file : bySize) {
+      buffer += first ? "{\"size\":" : ",{\"size\":";
+      first = false;
+      appendNumber(buffer, static_cast<uint64_t>(file.first));
+      buffer += ",\"path\":";
+      appendJsonString(buffer, table.path(file.second, path));
+      buffer += '}';
+    }
+    buffer += "]}\n";
+    break;
+  }
+  case Format::binary:
+    appendLittleEndian(buffer, static_cast<uint32_t>(files.size()));
+    appendBinaryDistance(buffer, cluster.getDistance());
+    for (auto& file : bySize) {
+      const auto& name = table.path(file.second, path);
+      appendLittleEndian(buffer, static_cast<uint64_t>(file.first));
+      appendLittleEndian(buffer, static_cast<uint32_t>(name.size()));
+      buffer += name;
+    }
+    break;
+  }
+}
+
+void ResultWriter::flush() {
+  if (buffer.empty()) {
+    return;
+  }
+  if (!failed) {
+    out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+    failed = out.fail();
+    if (!failed) {
+      written += buffer.size();
+    }
+  }
+  buffer.clear();
+}
@@ -0,0 +1,89 @@
+//
+//  ResultWriter.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef ResultWriter_hpp
+#define ResultWriter_hpp
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BoundedQueue.hh"
+#include "Cluster.hh"
+#include "FileTable.hh"
+
+using namespace std;
+
+/**
+ Writes the clusters to the results file from a thread of its own, while
+ the caller goes on with the next ones. The writer is handed the clusters
+ themselves, not copies, and formats them into a buffer which goes to the
+ file a megabyte at a time. Within a cluster the files are written largest
+ first, files of the same size in the order of their ids.
+
+ text is the format for people, a "# Section (size:N, distance:D)" line
+ followed by a "n:size path" line per file.
+ jsonl has one object per cluster and line,
+   {"size":2,"distance":1.5,"files":[{"size":1234,"path":"a.jpg"},...]}
+ with the paths as they are found, only quotes, backslashes and control
+ characters escaped.
+ binary starts with the four bytes "RDFC" and a version, then has a record
+ per cluster: the file count and the distance, then for each file its size,
+ the length of its path and the path without a terminating zero. Counts and
+ lengths are 32 bit, sizes 64 bit and the distance a 64 bit ieee double, all
+ little endian. The file ends after the last record.
+ */
+class ResultWriter {
+public:
+  enum class Format { text, jsonl, binary };
+
+  static constexpr uint32_t binaryVersion = 1;
+
+  // truncates filename and starts writing to it, see isOpen
+  ResultWriter(const FileTable& table, const string& filename, Format format);
+  // finishes, if finish was not called
+  ~ResultWriter();
+  ResultWriter(const ResultWriter&) = delete;
+  ResultWriter& operator=(const ResultWriter&) = delete;
+
+  // false if filename could not be opened, nothing is written then
+  bool isOpen() const { return writer.joinable(); }
+
+  // queues cluster for writing, it must stay unchanged until finish returns
+  void write(const Cluster& cluster);
+
+  // writes what is queued and closes the file, false if a write failed
+  bool finish();
+
+  uint64_t bytesWritten() const { return written; }
+
+private:
+  void run();
+  void append(const Cluster& cluster);
+  void flush();
+
+  const FileTable& table;
+  const Format format;
+  ofstream out;
+  BoundedQueue<const Cluster*> queue;
+
+  // only touched by the writer thread until it is joined
+  string buffer;
+  // the files of the cluster being written with their sizes, kept to be
+  // reused by the next cluster
+  vector<pair<FileTable::filesizetype, FileTable::Id>> bySize;
+  string path;
+  uint64_t written = 0;
+  bool failed = false;
+
+  thread writer;
+};
+
+#endif /* ResultWriter_hpp */
@@ -0,0 +1,112 @@
+//
+//  RunStats.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "config.h"
+
+#include "RunStats.hh"
+
+#include <fstream>
+#include <iostream>
+
+#include <sys/resource.h>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+RunStats::RunStats() : runStart(sample()) {}
+
+RunStats::Sample RunStats::sample() {
+  Sample s;
+  s.wall = chrono::steady_clock::now();
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    s.cpu = static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+            static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+  }
+  return s;
+}
+
+uint64_t RunStats::peakRssBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  // bytes on macos, kilobytes elsewhere
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+void RunStats::begin(const string& name) {
+  end();
+  current = name;
+  phaseStart = sample();
+}
+
+void RunStats::end() {
+  if (current.empty()) {
+    return;
+  }
+
+  const auto now = sample();
+  Phase phase;
+  phase.name = move(current);
+  phase.wallSeconds = chrono::duration<double>(now.wall - phaseStart.wall).count();
+  phase.cpuSeconds = now.cpu - phaseStart.cpu;
+  phase.peakRssBytes = peakRssBytes();
+  phases.push_back(move(phase));
+  current.clear();
+}
+
+void RunStats::count(const string& name, uint64_t value) {
+  counters.emplace_back(name, value);
+}
+
+void RunStats::seconds(const string& name, double value) {
+  durations.emplace_back(name, value);
+}
+
+bool RunStats::write(const string& path) {
+  end();
+
+  const auto now = sample();
+  json j;
+  j["version"] = VERSION;
+  j["wall_seconds"] = chrono::duration<double>(now.wall - runStart.wall).count();
+  j["cpu_seconds"] = now.cpu - runStart.cpu;
+  j["peak_rss_bytes"] = peakRssBytes();
+
+  // an array, so the phases keep the order they ran in
+  j["phases"] = json::array();
+  for (auto& phase : phases) {
+    j["phases"].push_back({
+      {"name", phase.name},
+      {"wall_seconds", phase.wallSeconds},
+      {"cpu_seconds", phase.cpuSeconds},
+      {"peak_rss_bytes", phase.peakRssBytes},
+    });
+  }
+
+  j["counters"] = json::object();
+  for (auto& counter : counters) {
+    j["counters"][counter.first] = counter.second;
+  }
+  for (auto& duration : durations) {
+    j["counters"][duration.first] = duration.second;
+  }
+
+  ofstream out(path);
+  out << j.dump(2) << '\n';
+  if (!out.flush()) {
+    cerr << "Couldn't write stats file " << path << endl;
+    return false;
+  }
+  return true;
+}
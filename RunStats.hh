@@ -0,0 +1,67 @@
+//
+//  RunStats.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef RunStats_hpp
+#define RunStats_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ Where the time of a run went, written as json with -stats so slow runs can
+ be told apart without a profiler. The run is split into phases, one after
+ the other. Each phase records its wall time, the cpu time of the process
+ (all threads) and the peak resident set size when it ended.
+ Work which overlaps a phase on other threads, like the stats of the walk or
+ the hashing while the walk is going on, is reported through counters the
+ phases fill in. Only used from the main thread.
+ */
+class RunStats {
+public:
+  RunStats();
+
+  // ends the current phase, if any, and starts the named one
+  void begin(const string& name);
+  // ends the current phase
+  void end();
+
+  // sets a counter, listed under "counters" in the json
+  void count(const string& name, uint64_t value);
+  void seconds(const string& name, double value);
+
+  // ends the current phase and writes the json. false if it could not be written.
+  bool write(const string& path);
+
+private:
+  struct Sample {
+    chrono::steady_clock::time_point wall;
+    double cpu = 0;
+  };
+  struct Phase {
+    string name;
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    uint64_t peakRssBytes = 0;
+  };
+
+  static Sample sample();
+  static uint64_t peakRssBytes();
+
+  Sample runStart;
+  Sample phaseStart;
+  string current;
+  vector<Phase> phases;
+  vector<pair<string, uint64_t>> counters;
+  vector<pair<string, double>> durations;
+};
+
+#endif /* RunStats_hpp */
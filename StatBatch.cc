@@ -0,0 +1,152 @@
+//
+//  StatBatch.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "config.h"
+
+#include "StatBatch.hh"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "IoRing.hh"
+#ifdef RDFIND_IO_URING
+#include <sys/sysmacros.h>
+#endif
+
+namespace {
+
+int statat(int dirfd, const char* name, struct stat& info, int flags) {
+  int res;
+  do {
+    res = fstatat(dirfd, name, &info, flags);
+  } while (res < 0 && errno == EINTR);
+  return res < 0 ? errno : 0;
+}
+
+} // namespace
+
+#ifdef RDFIND_IO_URING
+
+// the ring, and the results the kernel fills in for the current batch
+struct StatBatch::Ring {
+  IoRing io;
+  std::vector<struct statx> results;
+
+  Ring() : io(queueDepth, {IORING_OP_STATX}) {}
+};
+
+StatBatch::StatBatch(bool useIoUring) {
+  if (useIoUring) {
+    ring.reset(new Ring);
+    if (!ring->io.valid()) {
+      ring.reset();
+    }
+  }
+}
+
+bool StatBatch::statOnRing(int dirfd, const std::vector<const char*>& names, int flags,
+                           std::vector<struct stat>& infos, std::vector<int>& results) {
+  auto& r = *ring;
+  r.results.resize(names.size());
+
+  size_t next = 0;
+  size_t done = 0;
+  unsigned inFlight = 0;
+  while (done < names.size()) {
+    for (; next < names.size() && inFlight < r.io.capacity(); ++next, ++inFlight) {
+      io_uring_sqe& sqe = r.io.prepare();
+      sqe.opcode = IORING_OP_STATX;
+      sqe.fd = dirfd;
+      sqe.addr = reinterpret_cast<uint64_t>(names[next]);
+      sqe.len = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME;
+      sqe.statx_flags = static_cast<uint32_t>(flags);
+      sqe.off = reinterpret_cast<uint64_t>(&r.results[next]);
+      sqe.user_data = next;
+    }
+
+    if (!r.io.submit(1)) {
+      return false;
+    }
+
+    r.io.complete([&](const io_uring_cqe& cqe) {
+      const auto i = static_cast<size_t>(cqe.user_data);
+      if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+        results[i] = statat(dirfd, names[i], infos[i], flags);
+      } else if (cqe.res < 0) {
+        results[i] = -cqe.res;
+      } else {
+        const struct statx& x = r.results[i];
+        struct stat& info = infos[i];
+        memset(&info, 0, sizeof(info));
+        info.st_mode = x.stx_mode;
+        info.st_ino = x.stx_ino;
+        info.st_dev = makedev(x.stx_dev_major, x.stx_dev_minor);
+        info.st_size = static_cast<off_t>(x.stx_size);
+        info.st_mtim.tv_sec = x.stx_mtime.tv_sec;
+        info.st_mtim.tv_nsec = x.stx_mtime.tv_nsec;
+        results[i] = 0;
+      }
+      ++done;
+      --inFlight;
+    });
+  }
+  return true;
+}
+
+#else
+
+struct StatBatch::Ring {};
+
+StatBatch::StatBatch(bool) {}
+
+bool StatBatch::statOnRing(int, const std::vector<const char*>&, int,
+                           std::vector<struct stat>&, std::vector<int>&) {
+  return false;
+}
+
+#endif
+
+StatBatch::~StatBatch() = default;
+
+void StatBatch::statAt(int dirfd, const std::vector<const char*>& names, int flags,
+                       std::vector<struct stat>& infos, std::vector<int>& results) {
+  infos.resize(names.size());
+  results.assign(names.size(), 0);
+  if (names.empty()) {
+    return;
+  }
+
+  if (ring && !statOnRing(dirfd, names, flags, infos, results)) {
+    // requests still in flight write to the ring's buffers, so it is kept
+    // until the batch goes away, just not used anymore
+    retired = std::move(ring);
+  }
+  if (!ring) {
+    statOneByOne(dirfd, names, flags, infos, results);
+  }
+}
+
+void StatBatch::statOneByOne(int dirfd, const std::vector<const char*>& names, int flags,
+                             std::vector<struct stat>& infos, std::vector<int>& results) {
+  for (size_t i = 0; i < names.size(); ++i) {
+    results[i] = statat(dirfd, names[i], infos[i], flags);
+  }
+}
+
+StatBatch& StatBatch::forThread(bool useIoUring) {
+  // a ring per thread, so the walk threads submit without locking
+  if (useIoUring) {
+    thread_local StatBatch batch(true);
+    return batch;
+  }
+  thread_local StatBatch batch(false);
+  return batch;
+}
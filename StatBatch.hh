@@ -0,0 +1,67 @@
+//
+//  StatBatch.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef StatBatch_hpp
+#define StatBatch_hpp
+
+#include <memory>
+#include <vector>
+
+// os specific headers
+#include <sys/stat.h>
+
+/**
+ Stats many names relative to one directory. With io_uring the statx
+ requests are submitted in batches and up to queueDepth of them are in
+ flight at once, which hides the round trips of network and spinning
+ storage. Only the fields rdfind uses are asked for: type, mode, inode,
+ size and modification time (the device always comes along).
+ Without io_uring, either because it was not asked for or because the
+ kernel does not have it (or statx on it), the names are stat:ed one by one.
+ A StatBatch is used by one thread at a time.
+ */
+class StatBatch {
+public:
+  // requests in flight at most
+  static constexpr unsigned queueDepth = 256;
+
+  // tries io_uring if useIoUring is set, falls back to fstatat without it
+  explicit StatBatch(bool useIoUring);
+  ~StatBatch();
+  StatBatch(const StatBatch&) = delete;
+  StatBatch& operator=(const StatBatch&) = delete;
+
+  // true if the stats go through io_uring
+  bool usesIoUring() const { return ring != nullptr; }
+
+  /**
+   * stats each of names relative to dirfd, like fstatat with flags (0 or
+   * AT_SYMLINK_NOFOLLOW). results[i] is 0 if infos[i] was filled in, the
+   * errno of the failure otherwise. only st_mode, st_ino, st_dev, st_size
+   * and the modification time are set.
+   */
+  void statAt(int dirfd, const std::vector<const char*>& names, int flags,
+              std::vector<struct stat>& infos, std::vector<int>& results);
+
+  // the statx batcher of the calling thread, made on first use
+  static StatBatch& forThread(bool useIoUring);
+
+private:
+  struct Ring;
+
+  void statOneByOne(int dirfd, const std::vector<const char*>& names, int flags,
+                    std::vector<struct stat>& infos, std::vector<int>& results);
+  // false if the ring failed, the names are then stat:ed again one by one
+  bool statOnRing(int dirfd, const std::vector<const char*>& names, int flags,
+                  std::vector<struct stat>& infos, std::vector<int>& results);
+
+  std::unique_ptr<Ring> ring;
+  // a ring which failed, kept while requests in flight may write to it
+  std::unique_ptr<Ring> retired;
+};
+
+#endif /* StatBatch_hpp */
@@ -0,0 +1,175 @@
+//
+//  ThreadPool.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "ThreadPool.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+// index of the queue owned by the current worker, or npos for other threads
+thread_local size_t currentQueue = static_cast<size_t>(-1);
+} // namespace
+
+size_t ThreadPool::defaultThreadCount() {
+  return max<size_t>(1, thread::hardware_concurrency());
+}
+
+ThreadPool::ThreadPool(size_t threadCount) {
+  if (threadCount == 0) {
+    threadCount = defaultThreadCount();
+  }
+
+  // one queue per worker, plus one for tasks submitted by other threads
+  for (size_t i = 0; i < threadCount; ++i) {
+    queues.push_back(make_unique<Queue>());
+  }
+
+  for (size_t i = 0; i + 1 < threadCount; ++i) {
+    workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wakeUp.notify_all();
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+void ThreadPool::submit(Task task) {
+  size_t index = currentQueue;
+  if (index >= queues.size()) {
+    index = nextQueue++ % queues.size();
+  }
+
+  {
+    lock_guard<mutex> lock(queues[index]->mutex);
+    queues[index]->tasks.push_back(move(task));
+  }
+
+  {
+    lock_guard<mutex> lock(sleepMutex);
+    ++queuedCount;
+  }
+  wakeUp.notify_one();
+}
+
+bool ThreadPool::takeTask(size_t preferredQueue, Task& task) {
+  // own queue from the back, the task most likely to have its data in cache
+  if (preferredQueue < queues.size()) {
+    auto& q = *queues[preferredQueue];
+    lock_guard<mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      task = move(q.tasks.back());
+      q.tasks.pop_back();
+      --queuedCount;
+      return true;
+    }
+  }
+
+  // steal the oldest task from someone else
+  const size_t start = preferredQueue < queues.size() ? preferredQueue + 1 : 0;
+  for (size_t i = 0; i < queues.size(); ++i) {
+    auto& q = *queues[(start + i) % queues.size()];
+    lock_guard<mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      task = move(q.tasks.front());
+      q.tasks.pop_front();
+      --queuedCount;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ThreadPool::runOne(size_t preferredQueue) {
+  Task task;
+  if (!takeTask(preferredQueue, task)) {
+    return false;
+  }
+
+  task.group->execute(task);
+  return true;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+  currentQueue = index;
+  while (true) {
+    if (runOne(index)) {
+      continue;
+    }
+
+    unique_lock<mutex> lock(sleepMutex);
+    wakeUp.wait(lock, [this]() { return stopping || queuedCount > 0; });
+    if (stopping) {
+      return;
+    }
+  }
+}
+
+TaskGroup::~TaskGroup() {
+  cancel();
+  try {
+    wait();
+  } catch (...) {
+    // already reported to whoever waited, or nobody cares any more
+  }
+}
+
+void TaskGroup::run(function<void()> function) {
+  ++pendingCount;
+  pool.submit({move(function), this});
+}
+
+void TaskGroup::execute(ThreadPool::Task& task) {
+  if (!cancelled) {
+    try {
+      task.function();
+    } catch (...) {
+      lock_guard<mutex> lock(stateMutex);
+      if (!exception) {
+        exception = current_exception();
+      }
+      cancelled = true;
+    }
+  }
+
+  // release what the task captured before the waiter may return. the count
+  // drops under the lock, wait() takes it before returning so the group
+  // outlives this function.
+  task.function = nullptr;
+  lock_guard<mutex> lock(stateMutex);
+  if (--pendingCount == 0) {
+    done.notify_all();
+  }
+}
+
+void TaskGroup::wait() {
+  while (pendingCount > 0) {
+    if (pool.runOne(currentQueue)) {
+      continue;
+    }
+
+    // the remaining tasks are running on other threads
+    unique_lock<mutex> lock(stateMutex);
+    done.wait(lock, [this]() { return pendingCount == 0; });
+  }
+
+  lock_guard<mutex> lock(stateMutex);
+  if (exception) {
+    auto e = exception;
+    exception = nullptr;
+    rethrow_exception(e);
+  }
+}
@@ -0,0 +1,135 @@
+//
+//  ThreadPool.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+/**
+ A fixed set of worker threads, each with its own task deque. A worker takes
+ its newest task first and steals the oldest task of another worker when it
+ runs out, so a slow task only holds up its own thread.
+ The thread waiting on a TaskGroup runs tasks as well, which is why a pool of
+ threadCount threads starts threadCount - 1 workers. With one thread everything
+ runs in TaskGroup::wait on the caller.
+ */
+class ThreadPool {
+public:
+  // threadCount 0 picks the number of cores
+  explicit ThreadPool(size_t threadCount = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // threads working on tasks, including the waiting one
+  size_t threadCount() const { return workers.size() + 1; }
+
+  static size_t defaultThreadCount();
+
+private:
+  friend class TaskGroup;
+
+  struct Task {
+    std::function<void()> function;
+    TaskGroup* group;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void submit(Task task);
+  // runs one queued task on the calling thread, false if there was none
+  bool runOne(size_t preferredQueue);
+  bool takeTask(size_t preferredQueue, Task& task);
+  void workerLoop(size_t index);
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> queuedCount{0};
+  std::atomic<size_t> nextQueue{0};
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+  bool stopping = false;
+};
+
+/**
+ Tasks submitted together, which can be waited for and cancelled as a unit.
+ Cancelling drops the tasks which have not started, running tasks can poll
+ isCancelled() to stop early. The first exception thrown by a task cancels
+ the group and is rethrown by wait().
+ */
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool& owner) : pool(owner) {}
+  ~TaskGroup();
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  void run(std::function<void()> function);
+  void cancel() { cancelled = true; }
+  bool isCancelled() const { return cancelled; }
+
+  // helps running tasks until all tasks of this group are done
+  void wait();
+
+  ThreadPool& getPool() { return pool; }
+
+private:
+  friend class ThreadPool;
+
+  void execute(ThreadPool::Task& task);
+
+  ThreadPool& pool;
+  std::atomic<size_t> pendingCount{0};
+  std::atomic<bool> cancelled{false};
+  std::mutex stateMutex;
+  std::condition_variable done;
+  std::exception_ptr exception;
+};
+
+/**
+ * calls function(*it) for every element in [begin, end), in chunks of
+ * chunkSize elements run as separate tasks of group, and waits for them.
+ * chunkSize 0 picks a size giving each thread several chunks to steal.
+ */
+template <class Iterator, class Function>
+void parallelForEach(TaskGroup& group, Iterator begin, Iterator end, Function function, size_t chunkSize = 0) {
+  const auto count = static_cast<size_t>(std::distance(begin, end));
+  if (chunkSize == 0) {
+    chunkSize = std::max<size_t>(1, count / (group.getPool().threadCount() * 16));
+  }
+
+  for (size_t first = 0; first < count; first += chunkSize) {
+    const auto last = std::min(count, first + chunkSize);
+    auto chunkBegin = std::next(begin, static_cast<std::ptrdiff_t>(first));
+    auto chunkEnd = std::next(begin, static_cast<std::ptrdiff_t>(last));
+    group.run([&group, &function, chunkBegin, chunkEnd]() {
+      for (auto it = chunkBegin; it != chunkEnd && !group.isCancelled(); ++it) {
+        function(*it);
+      }
+    });
+  }
+
+  group.wait();
+}
+
+#endif /* ThreadPool_hpp */
@@ -4,32 +4,15 @@
 
 #include <vector>
 
-using namespace std;
-
-template <class T, class Creator>
-vector<thread> runInParallel(vector<T>& v, Creator creator) {
-  const auto coreCount = thread::hardware_concurrency();
-  const auto bucketSize = max((size_t)1, v.size() / (coreCount - 1));
-  
-  auto threads = vector<thread>();
-  for (int i = 0; i < v.size(); i += bucketSize) {
-    size_t resultBucketSize = 0;
-    if (i + bucketSize <= v.size()) {
-        resultBucketSize = bucketSize;
-    } else {
-        resultBucketSize = v.size() - i;
-    }
+#include "ThreadPool.hh"
 
-    threads.push_back(thread(
-      creator(
-         v.begin() + i,
-         v.begin() + i + resultBucketSize
-       )
-      )
-    );
-  }
+using namespace std;
 
-  return threads;
+// calls function on every element of v, spread over the pool in chunks
+template <class T, class Function>
+void runInParallel(ThreadPool& pool, vector<T>& v, Function function) {
+  TaskGroup group(pool);
+  parallelForEach(group, v.begin(), v.end(), function);
 }
 
 #endif /* Tools_hpp */
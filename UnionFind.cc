@@ -0,0 +1,56 @@
+//
+//  UnionFind.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "UnionFind.hh"
+
+#include <utility>
+
+UnionFind::UnionFind(size_t idCount)
+  : count(idCount)
+  , parents(new std::atomic<uint32_t>[idCount])
+{
+  for (size_t i = 0; i < count; ++i) {
+    parents[i].store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+  }
+}
+
+uint32_t UnionFind::find(uint32_t id) {
+  while (true) {
+    uint32_t parent = parents[id].load(std::memory_order_acquire);
+    if (parent == id) {
+      return id;
+    }
+
+    // path halving. a parent only ever moves to a smaller id of the same
+    // set, so a lost race leaves a valid, if longer, path.
+    const uint32_t grandparent = parents[parent].load(std::memory_order_acquire);
+    if (grandparent != parent) {
+      parents[id].compare_exchange_weak(parent, grandparent, std::memory_order_acq_rel);
+    }
+    id = grandparent;
+  }
+}
+
+void UnionFind::unite(uint32_t a, uint32_t b) {
+  while (true) {
+    a = find(a);
+    b = find(b);
+    if (a == b) {
+      return;
+    }
+    if (a < b) {
+      std::swap(a, b);
+    }
+
+    // a is the larger root. if another thread linked it meanwhile, retry from
+    // the new roots.
+    uint32_t expected = a;
+    if (parents[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel)) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,41 @@
+//
+//  UnionFind.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef UnionFind_hpp
+#define UnionFind_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ Disjoint sets over the ids 0..idCount-1, safe to use from many threads at
+ once without locks. A root is always linked below the smaller root, so the
+ root of a set is its smallest id. Which sets end up joined, and which id
+ represents them, does not depend on the order unite is called in.
+ */
+class UnionFind {
+public:
+  explicit UnionFind(size_t idCount);
+  UnionFind(const UnionFind&) = delete;
+  UnionFind& operator=(const UnionFind&) = delete;
+
+  size_t size() const { return count; }
+
+  // the smallest id in the set of id
+  uint32_t find(uint32_t id);
+
+  // joins the sets of a and b
+  void unite(uint32_t a, uint32_t b);
+
+private:
+  size_t count;
+  std::unique_ptr<std::atomic<uint32_t>[]> parents;
+};
+
+#endif /* UnionFind_hpp */
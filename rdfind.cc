@@ -8,16 +8,26 @@
 
 // std
 #include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 // project
 #include "CmdlineParser.hh"
 #include "Dirlist.hh"     //to find files
-#include "Fileinfo.hh"    //file container
+#include "FileTable.hh"   //file container
+#include "HashPipeline.hh"
+#include "MemoryBudget.hh"
+#include "ProgressReporter.hh"
 #include "RdfindDebug.hh" //debug macro
 #include "Rdutil.hh"      //to do some work
+#include "ResultWriter.hh"
+#include "RunStats.hh"
+#include "StatBatch.hh"
+#include "ThreadPool.hh"
 
 #include <opencv2/opencv.hpp>
 
@@ -27,19 +37,17 @@ using namespace std;
 
 // global variables
 
-// this vector holds the information about all files found
-vector<Ptr<Fileinfo>> filelist;
-struct Options;
-const Options* global_options{};
+Cache cache;
 
-void loadListOfFiles(Rdutil& gswd, Parser& parser, const Options& o);
+// this table holds the information about all files found
+FileTable filetable(&cache);
 
-/**
- * this contains the command line index for the path currently
- * being investigated. it has to be global, because function pointers
- * are being used.
- */
-int current_cmdline_index = 0;
+// the files worked on, rows of filetable
+vector<FileTable::Id> filelist;
+struct Options;
+
+void loadListOfFiles(Rdutil& gswd, Parser& parser, const Options& o, ThreadPool& pool, MemoryBudget& decodeBudget,
+                     RunStats& stats);
 
 static void
 usage()
@@ -66,13 +74,47 @@ usage()
     << " -maxsize N        (N=0)          ignores files with size N "
        "bytes and larger (use 0 to disable this check).\n"
     << " -followsymlinks    true |(false) follow symlinks\n"
+    << " -iouring           true |(false) stat the files of a directory in\n"
+    << "                                  batches through io_uring, which\n"
+    << "                                  helps on network and spinning disks.\n"
+    << "                                  images are then read through it too\n"
     << " -removeidentinode (true)| false  ignore files with nonunique "
        "device and inode\n"
     << " -deterministic    (true)| false  makes results independent of order\n"
     << "                                  from listing the filesystem\n"
     << " -outputname  name  sets the results file name to \"name\" "
        "(default results.txt)\n"
+    << " -outputformat      (text)|jsonl|binary  the format of the results\n"
+    << "                                  file, jsonl has a json object per\n"
+    << "                                  cluster and line, binary is described\n"
+    << "                                  in ResultWriter.hh\n"
+    << " -progress          true |(false)|json  report how far the hashing\n"
+    << "                                  got to stderr, as text or one json\n"
+    << "                                  object per line\n"
+    << " -progressinterval N (N=10)       seconds between progress reports\n"
+    << " -stats name        writes the time and memory each phase took as\n"
+    << "                                  json to \"name\"\n"
     << " -deleteduplicates  true |(false) delete duplicate files\n"
+    << " -threads N        (N=0)          number of threads for the directory\n"
+    << "                                  walk and other parallel work, 0 uses\n"
+    << "                                  all cores\n"
+    << " -readers N        (N=4)          number of threads reading images\n"
+    << " -iodepth N        (N=32)         reads each reader keeps in flight\n"
+    << "                                  with -iouring true\n"
+    << " -hashers N        (N=0)          number of threads decoding and\n"
+    << "                                  hashing images, 0 uses all cores\n"
+    << " -memlimit N       (N=0)          bytes the decoded images may take at\n"
+    << "                                  once, with a k, M or G suffix for\n"
+    << "                                  KiB, MiB or GiB. larger images wait for\n"
+    << "                                  memory, 0 means no limit\n"
+    << " -clustering method (greedy)|unionfind|sharded  how similar images\n"
+    << "                                  are grouped. greedy puts a file in\n"
+    << "                                  the first cluster it is close to all\n"
+    << "                                  members of, unionfind joins every two\n"
+    << "                                  close files and does not depend on\n"
+    << "                                  the order files are found in.\n"
+    << "                                  sharded gives the unionfind clusters,\n"
+    << "                                  computed on all cores\n"
     << " -h|-help|--help                  show this help and exit\n"
     << " -v|--version                     display version number and exit\n"
     << '\n'
@@ -83,23 +125,55 @@ usage()
     << "version is " << VERSION << '\n';
 }
 
-Cache cache;
-
 struct Options {
   // operation mode and default values
-  Fileinfo::filesizetype minimumfilesize =
+  FileTable::filesizetype minimumfilesize =
     1; // minimum file size to be noticed (0 - include empty files)
-  Fileinfo::filesizetype maximumfilesize =
+  FileTable::filesizetype maximumfilesize =
     0; // if nonzero, files this size or larger are ignored
   bool followsymlinks = false;        // follow symlinks
+  bool iouring = false;               // batch the stats of the walk
   bool remove_identical_inode = true; // remove files with identical inodes
   bool deterministic = false; // be independent of filesystem order
   string resultsfile = "rdfind_results.txt"; // results file name.
+  ResultWriter::Format resultsFormat = ResultWriter::Format::text;
   string cachefile = ""; // cache file name.
+  string statsfile = ""; // phase statistics file name, empty for none
+  bool progress = false; // report the hashing progress to stderr
+  ProgressReporter::Format progressFormat = ProgressReporter::Format::text;
+  long long progressInterval = 10; // seconds between progress reports
   const char* clusterPath = ""; // path to folder-clusters
   const char* excludeClusterPath = ""; // subpath to exclude from cluster path
+  size_t threads = 0; // worker threads, 0 means one per core
+  size_t readers = HashPipeline::defaultReaderCount; // threads reading images
+  unsigned iodepth = HashPipeline::defaultIoDepth; // reads in flight per reader
+  size_t hashers = 0; // threads decoding images, 0 means one per core
+  uint64_t memlimit = 0; // bytes for decoding at once, 0 means no limit
+  enum class Clustering { greedy, unionFind, sharded };
+  Clustering clustering = Clustering::greedy; // how clusters are built
 };
 
+// a number of bytes, optionally with a k, M or G suffix for KiB, MiB or GiB
+uint64_t parseByteCount(const string& text) {
+  size_t end = 0;
+  const long long value = stoll(text, &end);
+  if (value < 0) {
+    throw runtime_error("negative value of memlimit not allowed");
+  }
+  int shift = 0;
+  const string suffix = text.substr(end);
+  if (suffix == "k" || suffix == "K") {
+    shift = 10;
+  } else if (suffix == "m" || suffix == "M") {
+    shift = 20;
+  } else if (suffix == "g" || suffix == "G") {
+    shift = 30;
+  } else if (!suffix.empty()) {
+    throw runtime_error("memlimit takes a k, M or G suffix");
+  }
+  return static_cast<uint64_t>(value) << shift;
+}
+
 Options parseOptions(Parser& parser) {
   Options o;
   for (; parser.has_args_left(); parser.advance()) {
@@ -118,8 +192,37 @@ Options parseOptions(Parser& parser) {
     }
     if (parser.try_parse_string("-outputname")) {
       o.resultsfile = parser.get_parsed_string();
+    } else if (parser.try_parse_string("-outputformat")) {
+      const string format = parser.get_parsed_string();
+      if (format == "text") {
+        o.resultsFormat = ResultWriter::Format::text;
+      } else if (format == "jsonl") {
+        o.resultsFormat = ResultWriter::Format::jsonl;
+      } else if (format == "binary") {
+        o.resultsFormat = ResultWriter::Format::binary;
+      } else {
+        throw runtime_error("outputformat must be text, jsonl or binary");
+      }
     } else if (parser.try_parse_string("-cachename")) {
       o.cachefile = parser.get_parsed_string();
+    } else if (parser.try_parse_string("-stats")) {
+      o.statsfile = parser.get_parsed_string();
+    } else if (parser.try_parse_string("-progress")) {
+      const string progress = parser.get_parsed_string();
+      if (progress == "json") {
+        o.progress = true;
+        o.progressFormat = ProgressReporter::Format::json;
+      } else if (progress == "true" || progress == "false") {
+        o.progress = progress == "true";
+        o.progressFormat = ProgressReporter::Format::text;
+      } else {
+        throw runtime_error("progress must be true, false or json");
+      }
+    } else if (parser.try_parse_string("-progressinterval")) {
+      o.progressInterval = stoll(parser.get_parsed_string());
+      if (o.progressInterval < 1) {
+        throw runtime_error("progressinterval must be at least 1");
+      }
     } else if (parser.try_parse_bool("-ignoreempty")) {
       if (parser.get_parsed_bool()) {
         o.minimumfilesize = 1;
@@ -140,10 +243,50 @@ Options parseOptions(Parser& parser) {
       o.maximumfilesize = maxsize;
     } else if (parser.try_parse_bool("-followsymlinks")) {
       o.followsymlinks = parser.get_parsed_bool();
+    } else if (parser.try_parse_bool("-iouring")) {
+      o.iouring = parser.get_parsed_bool();
     } else if (parser.try_parse_bool("-removeidentinode")) {
       o.remove_identical_inode = parser.get_parsed_bool();
     } else if (parser.try_parse_bool("-deterministic")) {
       o.deterministic = parser.get_parsed_bool();
+    } else if (parser.try_parse_string("-threads")) {
+      const long long threads = stoll(parser.get_parsed_string());
+      if (threads < 0) {
+        throw runtime_error("negative value of threads not allowed");
+      }
+      o.threads = static_cast<size_t>(threads);
+    } else if (parser.try_parse_string("-readers")) {
+      const long long readers = stoll(parser.get_parsed_string());
+      if (readers < 1) {
+        throw runtime_error("readers must be at least 1");
+      }
+      o.readers = static_cast<size_t>(readers);
+    } else if (parser.try_parse_string("-iodepth")) {
+      const long long iodepth = stoll(parser.get_parsed_string());
+      if (iodepth < 1 || iodepth > 4096) {
+        throw runtime_error("iodepth must be between 1 and 4096");
+      }
+      o.iodepth = static_cast<unsigned>(iodepth);
+    } else if (parser.try_parse_string("-hashers")) {
+      const long long hashers = stoll(parser.get_parsed_string());
+      if (hashers < 0) {
+        throw runtime_error("negative value of hashers not allowed");
+      }
+      o.hashers = static_cast<size_t>(hashers);
+    } else if (parser.try_parse_string("-memlimit")) {
+      o.memlimit = parseByteCount(parser.get_parsed_string());
+    } else if (parser.try_parse_string("-clustering")) {
+      const string method = parser.get_parsed_string();
+      if (method == "greedy") {
+        o.clustering = Options::Clustering::greedy;
+      } else if (method == "unionfind") {
+        o.clustering = Options::Clustering::unionFind;
+      } else if (method == "sharded") {
+        o.clustering = Options::Clustering::sharded;
+      } else {
+        cerr << "expected greedy, unionfind or sharded, not \"" << method << "\"\n";
+        exit(EXIT_FAILURE);
+      }
     } else if (parser.try_parse_string("-clusterpath")) {
       o.clusterPath = parser.get_parsed_string();
     } else if (parser.try_parse_string("-excludeclusterpath")) {
@@ -181,31 +324,6 @@ Options parseOptions(Parser& parser) {
   return o;
 }
 
-// function to add items to the list of all files
-static int report(const string& path, const string& name, int depth) {
-  RDDEBUG("report(" << path.c_str() << "," << name.c_str() << "," << depth
-                    << ")" << endl);
-
-  // expand the name if the path is nonempty
-  string expandedname = path.empty() ? name : (path + "/" + name);
-
-  Ptr<Fileinfo> tmp = make_shared<Fileinfo>(expandedname, current_cmdline_index, depth, &cache);
-  if (tmp.get()->readfileinfo()) {
-    if (tmp.get()->isRegularFile()) {
-      const auto size = tmp.get()->size();
-      if (size >= global_options->minimumfilesize &&
-          size < global_options->maximumfilesize) {
-        filelist.emplace_back(tmp);
-      }
-    }
-  } else {
-    cerr << "failed to read file info on file \"" << tmp.get()->name() << '\n';
-    return -1;
-  }
-  return 0;
-}
-
-
 int main(int narg, const char* argv[]) {
   if (narg == 1) {
     usage();
@@ -216,48 +334,79 @@ int main(int narg, const char* argv[]) {
   Parser parser(narg, argv);
   const Options o = parseOptions(parser);
 
+  RunStats stats;
+  // shared by the decodes of the path clusters and of the files found
+  MemoryBudget decodeBudget(o.memlimit);
   if (!o.cachefile.empty()) {
+    stats.begin("cache load");
     cache.load(o.cachefile);
   }
 
+  // shared by all parallel stages
+  ThreadPool pool(o.threads);
+
+  if (o.iouring && !StatBatch(true).usesIoUring()) {
+    cout << "io_uring is not available, the files are stat:ed one by one." << endl;
+  }
+
   // an object to do sorting and duplicate finding
-  Rdutil gswd(filelist);
+  Rdutil gswd(filetable, filelist, pool);
 
   bool sortingMode = false;
   if (strlen(o.clusterPath) > 0) {
+    stats.begin("path clusters");
     sortingMode = true;
-    Dirlist dirlist(o.followsymlinks);
-    gswd.buildPathClusters(o.clusterPath, o.excludeClusterPath, dirlist, cache);
+    Dirlist dirlist(o.followsymlinks, o.iouring, pool);
+    gswd.buildPathClusters(o.clusterPath, o.excludeClusterPath, dirlist, decodeBudget);
   }
   
-  loadListOfFiles(gswd, parser, o);
+  loadListOfFiles(gswd, parser, o, pool, decodeBudget, stats);
 
   if (o.remove_identical_inode) {
+    stats.begin("inode dedup");
     // remove files with identical devices and inodes from the list
+    const auto removed = gswd.removeIdenticalInodes();
+    stats.count("identical_inodes", removed);
     cout << "Excluded "
-    << gswd.removeIdenticalInodes()
+    << removed
     << " files due to nonunique device and inode." << endl;
   }
 
+  stats.begin("filter");
+
   cout << "Total size is "
   << gswd.totalsizeinbytes()
   << " bytes or ";
   gswd.totalsize(cout) << endl;
 
+  const auto nonImages = gswd.removeNonImages();
+  stats.count("non_images", nonImages);
   cout << "Excluded "
-  << gswd.removeNonImages()
+  << nonImages
   << " non image files from list. ";
   
   cout << filelist.size()
   << " files left." << endl;
   
-  gswd.calcHashes();
+  // the hashes were calculated during the scan
   if (!o.cachefile.empty()) {
+    stats.begin("cache save");
     cache.save();
   }
 
-  gswd.removeInvalidImages();
-  gswd.buildClusters();
+  stats.begin("clustering");
+  stats.count("invalid_images", gswd.removeInvalidImages());
+  switch (o.clustering) {
+  case Options::Clustering::greedy:
+    gswd.buildClusters();
+    break;
+  case Options::Clustering::unionFind:
+    gswd.buildClustersUnionFind();
+    break;
+  case Options::Clustering::sharded:
+    gswd.buildClustersSharded();
+    break;
+  }
 
   cout << "Builting clusters... " << endl;
   cout << "Built "
@@ -273,8 +422,10 @@ int main(int narg, const char* argv[]) {
   cout << gswd.clusterFileCount()
   << " files left" << endl;
   
-  gswd.sortClustersBySize();
+  stats.count("clusters", gswd.getClusters().size());
+  stats.count("clustered_files", gswd.clusterFileCount());
 
+  stats.begin("output");
   cout << "Totally, ";
   gswd.saveablespace(cout)
   << " can be reduced." << endl;
@@ -282,46 +433,123 @@ int main(int narg, const char* argv[]) {
   // traverse the list and make a nice file with the results
   cout << "Now making results file "
   << o.resultsfile << endl;
-  gswd.printtofile(o.resultsfile);
+  gswd.printtofile(o.resultsfile, o.resultsFormat);
   
   //gswd.calcClusterSortSuggestions();
 
+  if (!o.statsfile.empty()) {
+    stats.write(o.statsfile);
+  }
+
   return 0;
 }
 
-void loadListOfFiles(Rdutil& gswd, Parser& parser, const Options& o) {
-  // an object to traverse the directory structure
-  Dirlist dirlist(o.followsymlinks);
+void loadListOfFiles(Rdutil& gswd, Parser& parser, const Options& o, ThreadPool& pool, MemoryBudget& decodeBudget,
+                     RunStats& stats) {
+  // done with arguments. collect the files and directories to traverse.
+  vector<string> roots;
+  vector<int> cmdlineIndexes;
+  for (; parser.has_args_left(); parser.advance()) {
+    string arg(parser.get_current_arg());
+    // remove trailing /
+    while (arg.back() == '/' && arg.size() > 1) {
+      arg.erase(arg.size() - 1);
+    }
+    roots.push_back(arg);
+    cmdlineIndexes.push_back(parser.get_current_index());
+  }
 
-  // this is what function is called when an object is found on
-  // the directory traversed by walk. Make sure the pointer to the
-  // options is set as well.
-  global_options = &o;
-  dirlist.setcallbackfcn(&report);
+  // the roots and their directories are walked concurrently, so the files
+  // found are kept per directory and put in walk order afterwards, the
+  // roots in command line order.
+  struct FoundDirectory {
+    DirlistPosition position;
+    vector<FileTable::Id> files;
+  };
+  vector<vector<FoundDirectory>> found(roots.size());
+  mutex foundMutex;
+
+  // images are read and hashed as soon as the walk finds them, so the walk
+  // phase includes hashing and the hashing phase is what is left of it
+  stats.begin("walk");
+  HashPipeline hashPipeline(filetable, o.readers, o.hashers, o.iouring ? o.iodepth : 0, decodeBudget);
+  unique_ptr<ProgressReporter> progress;
+  if (o.progress) {
+    progress.reset(new ProgressReporter(hashPipeline, chrono::seconds(o.progressInterval), o.progressFormat, cerr));
+  }
 
-  // now loop over path list and add the files
+  // an object to traverse the directory structure
+  Dirlist dirlist(o.followsymlinks, o.iouring, pool);
+
+  // this is called for every directory found by walk, with the regular
+  // files in it.
+  dirlist.walk(roots, [&](size_t rootIndex, const DirlistPosition& position, const string& path, int depth,
+                          vector<DirlistEntry>& files) {
+    vector<FileTable::Id> accepted;
+    // interned once for the whole directory, the files keep their basename
+    const auto dir = filetable.addDirectory(path);
+    for (auto& file : files) {
+      const auto size = static_cast<FileTable::filesizetype>(file.info.st_size);
+      if (size < o.minimumfilesize || size >= o.maximumfilesize) {
+        continue;
+      }
 
-  // done with arguments. start parsing files and directories!
-  for (; parser.has_args_left(); parser.advance()) {
-    // get the next arg.
-    const string file_or_dir = [&]() {
-      string arg(parser.get_current_arg());
-      // remove trailing /
-      while (arg.back() == '/' && arg.size() > 1) {
-        arg.erase(arg.size() - 1);
+      const auto id = filetable.add(dir, file.name, cmdlineIndexes[rootIndex], depth, file.info);
+      if (filetable.isImage(id)) {
+        hashPipeline.submit(id);
       }
-      return arg;
-    }();
+      accepted.push_back(id);
+    }
 
-    auto lastsize = filelist.size();
-    cout << "Now scanning \""
-    << file_or_dir << "\"";
-    cout.flush();
+    lock_guard<mutex> lock(foundMutex);
+    found[rootIndex].push_back({position, move(accepted)});
+  });
+  stats.count("directories", dirlist.directoryCount());
+  stats.count("stats", dirlist.statCount());
+  stats.seconds("stat_seconds", dirlist.statSeconds());
 
-    current_cmdline_index = parser.get_current_index();
-    dirlist.walk(file_or_dir, 0);
+  stats.begin("hashing");
+  if (progress) {
+    progress->setTotalKnown();
+  }
+  hashPipeline.finish();
+  if (progress) {
+    progress->stop();
+  }
+  stats.count("cache_hits", hashPipeline.cachedCount());
+  stats.count("decodes", hashPipeline.decodeCount());
+  stats.count("identical_copies", hashPipeline.identicalCount());
+  stats.count("hard_links", hashPipeline.linkedCount());
+  stats.count("failed_images", hashPipeline.invalidCount());
+  stats.count("oversized_decodes", hashPipeline.oversizedCount());
+  stats.count("skipped_oversized", hashPipeline.skippedCount());
+  stats.count("peak_decode_bytes", decodeBudget.peak());
+  stats.count("bytes_read", hashPipeline.bytesRead());
+  stats.seconds("reader_cpu_seconds", hashPipeline.readerCpuSeconds());
+  stats.seconds("hasher_cpu_seconds", hashPipeline.hasherCpuSeconds());
+  if (hashPipeline.skippedCount() > 0) {
+    cout << "Left out "
+    << hashPipeline.skippedCount()
+    << " images too large to decode within -memlimit." << endl;
+  }
+  if (hashPipeline.identicalCount() > 0) {
+    cout << "Took the hashes of "
+    << hashPipeline.identicalCount()
+    << " byte identical images from their copies." << endl;
+  }
+
+  stats.begin("ordering");
+  for (size_t i = 0; i < roots.size(); ++i) {
+    auto lastsize = filelist.size();
+    // the order of a serial walk, the same in every run
+    sort(found[i].begin(), found[i].end(),
+         [](const FoundDirectory& a, const FoundDirectory& b) { return a.position < b.position; });
+    for (auto& directory : found[i]) {
+      filelist.insert(filelist.end(), directory.files.begin(), directory.files.end());
+    }
 
-    cout << ", found "
+    cout << "Now scanning \""
+    << roots[i] << "\", found "
     << filelist.size() - lastsize
     << " files." << endl;
 
@@ -335,6 +563,7 @@ void loadListOfFiles(Rdutil& gswd, Parser& parser, const Options& o) {
   cout << "Now have "
   << filelist.size()
   << " files in total." << endl;
+  stats.count("files", filelist.size());
 
   // mark files with a number for correct ranking. The only ordering at this
   // point is that files found on early command line index are earlier in the
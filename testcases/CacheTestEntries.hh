@@ -0,0 +1,34 @@
+//
+//  CacheTestEntries.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef CacheTestEntries_hpp
+#define CacheTestEntries_hpp
+
+#include <cstdint>
+
+#include "../Cache.hh"
+
+// an entry of the tests, its hashes and stamp derived from value
+inline CacheEntry makeEntry(uint64_t value) {
+  CacheEntry entry;
+  entry.averageHash.setWord(0, value);
+  entry.pHash.setWord(0, ~value);
+  entry.hasAverageHash = true;
+  entry.hasPHash = true;
+  entry.stamp.size = static_cast<int64_t>(value);
+  entry.hasStamp = true;
+  return entry;
+}
+
+// the stamp of the entry makeEntry(value)
+inline FileStamp makeStamp(uint64_t value) {
+  FileStamp stamp;
+  stamp.size = static_cast<int64_t>(value);
+  return stamp;
+}
+
+#endif /* CacheTestEntries_hpp */
@@ -0,0 +1,237 @@
+//
+//  ImageCorpus.cc
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#include "ImageCorpus.hh"
+
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include <opencv2/img_hash.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "../EasyRandom.hh"
+#include "../ImageHash.hh"
+#include "../ImageReader.hh"
+
+namespace {
+
+const CorpusTransform variantTransforms[] = {
+  CorpusTransform::resize,
+  CorpusTransform::recompress,
+  CorpusTransform::crop,
+  CorpusTransform::brightness,
+};
+
+bool makeDirectory(const string& path) {
+  if (mkdir(path.c_str(), 0755) == 0 || errno == EEXIST) {
+    return true;
+  }
+  cerr << "Couldn't create directory " << path << endl;
+  return false;
+}
+
+cv::Scalar randomColor(EasyRandom& random) {
+  return cv::Scalar(random.uniformInt(0, 255), random.uniformInt(0, 255), random.uniformInt(0, 255));
+}
+
+// shapes on a vertical gradient, so the originals differ in their coarse
+// structure and not only in detail the hashes do not see
+cv::Mat makeOriginal(EasyRandom& random, int maxSide) {
+  const int longSide = random.uniformInt(max(maxSide / 2, 16), max(maxSide, 16));
+  const int shortSide = static_cast<int>(longSide * random.uniformReal(0.5, 1.0));
+  const bool landscape = random.uniformInt(0, 3) != 0;
+  const int width = landscape ? longSide : shortSide;
+  const int height = landscape ? shortSide : longSide;
+
+  cv::Mat image(height, width, CV_8UC3);
+  const cv::Scalar top = randomColor(random);
+  const cv::Scalar bottom = randomColor(random);
+  for (int y = 0; y < height; ++y) {
+    const double t = static_cast<double>(y) / height;
+    image.row(y).setTo(top * (1.0 - t) + bottom * t);
+  }
+
+  const int shapes = random.uniformInt(8, 24);
+  for (int i = 0; i < shapes; ++i) {
+    const cv::Point a(random.uniformInt(0, width - 1), random.uniformInt(0, height - 1));
+    const cv::Point b(random.uniformInt(0, width - 1), random.uniformInt(0, height - 1));
+    const cv::Scalar color = randomColor(random);
+    // filled most of the time, the outlines add some edges
+    const int thickness = random.uniformInt(0, 2) == 0 ? random.uniformInt(2, 8) : cv::FILLED;
+    switch (random.uniformInt(0, 2)) {
+    case 0:
+      cv::rectangle(image, a, b, color, thickness);
+      break;
+    case 1:
+      cv::circle(image, a, random.uniformInt(4, max(shortSide / 4, 5)), color, thickness);
+      break;
+    default:
+      cv::line(image, a, b, color, thickness == cv::FILLED ? 12 : thickness);
+      break;
+    }
+  }
+  return image;
+}
+
+// the variant and the jpeg quality to write it with
+cv::Mat makeVariant(EasyRandom& random, const cv::Mat& original, CorpusTransform transform, int& quality) {
+  cv::Mat variant;
+  quality = 90;
+  switch (transform) {
+  case CorpusTransform::resize: {
+    const double scale = random.uniformReal(0.4, 0.9);
+    cv::resize(original, variant, cv::Size(), scale, scale, cv::INTER_AREA);
+    break;
+  }
+  case CorpusTransform::recompress:
+    variant = original;
+    quality = random.uniformInt(30, 70);
+    break;
+  case CorpusTransform::crop: {
+    // up to 4% off each side
+    const int left = random.uniformInt(0, original.cols / 25);
+    const int right = random.uniformInt(0, original.cols / 25);
+    const int top = random.uniformInt(0, original.rows / 25);
+    const int bottom = random.uniformInt(0, original.rows / 25);
+    variant = original(cv::Rect(left, top, original.cols - left - right, original.rows - top - bottom)).clone();
+    break;
+  }
+  case CorpusTransform::brightness: {
+    const int shift = random.uniformInt(10, 40);
+    original.convertTo(variant, -1, 1.0, random.uniformInt(0, 1) ? shift : -shift);
+    break;
+  }
+  case CorpusTransform::original:
+    variant = original;
+    break;
+  }
+  return variant;
+}
+
+} // namespace
+
+const char* transformName(CorpusTransform transform) {
+  switch (transform) {
+  case CorpusTransform::original:
+    return "original";
+  case CorpusTransform::resize:
+    return "resize";
+  case CorpusTransform::recompress:
+    return "recompress";
+  case CorpusTransform::crop:
+    return "crop";
+  case CorpusTransform::brightness:
+    return "brightness";
+  }
+  return "unknown";
+}
+
+vector<CorpusFile> writeImageCorpus(const string& root, const CorpusOptions& options) {
+  EasyRandom random(options.seed);
+
+  // the directories files go to, every level of the tree gets some
+  vector<string> directories{""};
+  for (size_t first = 0, level = 0; level < static_cast<size_t>(options.depth); ++level) {
+    const size_t last = directories.size();
+    for (size_t i = first; i < last; ++i) {
+      for (int j = 0; j < options.fanout; ++j) {
+        const string dir = directories[i] + "d" + to_string(j) + "/";
+        if (!makeDirectory(root + "/" + dir)) {
+          return {};
+        }
+        directories.push_back(dir);
+      }
+    }
+    first = last;
+  }
+
+  vector<CorpusFile> files;
+  for (size_t group = 0; group < options.images; ++group) {
+    const cv::Mat original = makeOriginal(random, options.maxSide);
+    // a few originals are png, their variants keep the format unless recompressed
+    const bool png = random.uniformInt(0, 4) == 0;
+
+    for (size_t v = 0; v <= options.variants; ++v) {
+      CorpusFile file;
+      file.group = group;
+      file.transform = v == 0 ? CorpusTransform::original : variantTransforms[(group + v - 1) % 4];
+
+      int quality = 90;
+      const cv::Mat image = makeVariant(random, original, file.transform, quality);
+      const bool asPng = png && file.transform != CorpusTransform::recompress;
+      const auto& dir = directories[static_cast<size_t>(random.uniformInt(0, static_cast<int>(directories.size()) - 1))];
+      file.path = dir + random.makeRandomFileString(12) + (asPng ? ".png" : ".jpg");
+
+      const vector<int> params =
+        asPng ? vector<int>{cv::IMWRITE_PNG_COMPRESSION, 3} : vector<int>{cv::IMWRITE_JPEG_QUALITY, quality};
+      if (!cv::imwrite(root + "/" + file.path, image, params)) {
+        cerr << "Couldn't write " << root << "/" << file.path << endl;
+        return files;
+      }
+      files.push_back(move(file));
+    }
+  }
+  return files;
+}
+
+bool writeCorpusManifest(const string& path, const vector<CorpusFile>& files) {
+  ofstream out(path);
+  for (auto& file : files) {
+    out << file.group << ' ' << transformName(file.transform) << ' ' << file.path << '\n';
+  }
+  return static_cast<bool>(out.flush());
+}
+
+bool readCorpusManifest(const string& path, vector<CorpusFile>& files) {
+  ifstream in(path);
+  if (!in) {
+    return false;
+  }
+
+  files.clear();
+  CorpusFile file;
+  string transform;
+  while (in >> file.group >> transform >> file.path) {
+    file.transform = CorpusTransform::original;
+    for (auto t : variantTransforms) {
+      if (transform == transformName(t)) {
+        file.transform = t;
+      }
+    }
+    files.push_back(file);
+  }
+  return true;
+}
+
+int reducedDecodeDrift(const string& path) {
+  ImageInfo info;
+  readImageInfo(path, info);
+  if (hashDecodeFlags(info) == cv::IMREAD_GRAYSCALE) {
+    // decoded in full anyway
+    return -1;
+  }
+  const cv::Mat reduced = readImageForHashing(path);
+  // older versions hashed the color image, the hashes convert it to gray
+  const cv::Mat color = cv::imread(path);
+  if (reduced.empty() || color.empty()) {
+    return -1;
+  }
+
+  int drift = 0;
+  const cv::Ptr<cv::img_hash::ImgHashBase> hashers[] = {cv::img_hash::AverageHash::create(),
+                                                        cv::img_hash::PHash::create()};
+  for (auto& hasher : hashers) {
+    cv::Mat reducedHash, colorHash;
+    hasher->compute(reduced, reducedHash);
+    hasher->compute(color, colorHash);
+    drift = max(drift, ImageHash::fromMat(reducedHash).distance(ImageHash::fromMat(colorHash)));
+  }
+  return drift;
+}
@@ -0,0 +1,68 @@
+//
+//  ImageCorpus.hh
+//  rdfind
+//
+//  Created by Alexey Glushkov on 16.10.2026.
+//
+
+#ifndef ImageCorpus_hpp
+#define ImageCorpus_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// what was done to an original to get a near duplicate of it
+enum class CorpusTransform { original, resize, recompress, crop, brightness };
+
+const char* transformName(CorpusTransform transform);
+
+struct CorpusOptions {
+  // distinct images, each written once as is
+  size_t images = 1000;
+  // near duplicates of each image, the transforms take turns
+  size_t variants = 3;
+  // levels of directories below the root, and subdirectories per directory
+  int depth = 3;
+  int fanout = 4;
+  // the long side of the originals is between maxSide / 2 and maxSide
+  int maxSide = 1024;
+  uint64_t seed = 1;
+};
+
+// a file of the corpus. files of the same group should end up in one cluster.
+struct CorpusFile {
+  size_t group = 0;
+  CorpusTransform transform = CorpusTransform::original;
+  // relative to the root of the corpus
+  string path;
+};
+
+/**
+ Writes a corpus of synthetic images below root, which must exist: originals
+ made of random shapes on a gradient, and near duplicates of them which are
+ resized, recompressed as jpeg, cropped by a few percent or brightened. The
+ files get random names and are spread over a tree of directories.
+ All randomness comes from EasyRandom seeded with options.seed, so the same
+ options give the same files on every run with the same OpenCV.
+ @return the files written, in the order they were written
+ */
+vector<CorpusFile> writeImageCorpus(const string& root, const CorpusOptions& options);
+
+// the name of the manifest in the root of a corpus
+const char* const corpusManifestName = "corpus.txt";
+
+// one line per file: group, transform and path
+bool writeCorpusManifest(const string& path, const vector<CorpusFile>& files);
+bool readCorpusManifest(const string& path, vector<CorpusFile>& files);
+
+/**
+ The bits the aHash or pHash of the image at path differ by at most between
+ the hashing decode and the full color decode older versions hashed, -1 if
+ the hashing decode of path is not reduced or either decode failed.
+ */
+int reducedDecodeDrift(const string& path);
+
+#endif /* ImageCorpus_hpp */
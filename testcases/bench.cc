@@ -0,0 +1,413 @@
+/*
+   Microbenchmarks for the stages of a run: walking, reading, decoding,
+   hashing, the hash pipeline, cache save and load, clustering and writing
+   the results. Not meant to be run for regular testing. run also checks
+   that the reduced jpeg decode keeps the hashes within a bit of a full
+   decode, and fails if it does not.
+   Build with "make bench". Write a corpus of synthetic images with
+     bench generate DIR [IMAGES [VARIANTS [SEED]]]
+   and measure on it with
+     bench run DIR
+   The same arguments to generate give the same corpus, so runs of different
+   versions or engines can be compared. Run as root to have the caches
+   dropped before each walk, otherwise both walks see a warm cache.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../Cache.hh"
+#include "../Dirlist.hh"
+#include "../FileTable.hh"
+#include "../HashPipeline.hh"
+#include "../ImageReader.hh"
+#include "../Rdutil.hh"
+#include "../ResultWriter.hh"
+#include "../ThreadPool.hh"
+#include "ImageCorpus.hh"
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+double seconds(Clock::duration elapsed) {
+  return chrono::duration<double>(elapsed).count();
+}
+
+void report(const string& stage, double count, const char* unit, double elapsed) {
+  cout << stage << ": " << count / elapsed << ' ' << unit << "/s (" << count << ' ' << unit << " in "
+       << elapsed << " s)\n";
+}
+
+// the files of the corpus, found the way rdfind finds them
+struct Corpus {
+  Cache cache;
+  FileTable table{&cache};
+  vector<FileTable::Id> files;
+  vector<FileTable::Id> images;
+};
+
+double walkCorpus(const string& root, bool batchedstat, ThreadPool& pool, Corpus& corpus) {
+  Dirlist dirlist(false, batchedstat, pool);
+  mutex foundMutex;
+  const auto start = Clock::now();
+  dirlist.walk({root}, [&](size_t, const DirlistPosition&, const string& path, int depth, vector<DirlistEntry>& entries) {
+    const auto dir = corpus.table.addDirectory(path);
+    lock_guard<mutex> lock(foundMutex);
+    for (auto& entry : entries) {
+      const auto id = corpus.table.add(dir, entry.name, 1, depth, entry.info);
+      corpus.files.push_back(id);
+      if (corpus.table.isImage(id)) {
+        corpus.images.push_back(id);
+      }
+    }
+  });
+  return seconds(Clock::now() - start);
+}
+
+// true if the page, dentry and inode caches could be dropped
+bool dropCaches() {
+  sync();
+  ofstream dropper("/proc/sys/vm/drop_caches");
+  dropper << "3\n";
+  return static_cast<bool>(dropper.flush());
+}
+
+// both walks start from the same cache state, cold if the caches can be
+// dropped and otherwise warmed by a walk which is not timed
+void benchWalk(const string& root, ThreadPool& pool, Corpus& corpus) {
+  const bool cold = dropCaches();
+  if (!cold) {
+    Corpus warmup;
+    walkCorpus(root, false, pool, warmup);
+  }
+  const double elapsed = walkCorpus(root, false, pool, corpus);
+  report("walk", static_cast<double>(corpus.files.size()), "files", elapsed);
+
+  if (cold) {
+    dropCaches();
+  }
+  Corpus batched;
+  const double batchedElapsed = walkCorpus(root, true, pool, batched);
+  report("walk io_uring", static_cast<double>(batched.files.size()), "files", batchedElapsed);
+  cout << "walk: " << (cold ? "cold" : "warm") << " cache\n";
+}
+
+// reads, decodes and hashes the images one at a time, which gives the
+// table the hashes the clustering needs
+void benchHashing(Corpus& corpus) {
+  Clock::duration readTime{}, decodeTime{}, hashTime{};
+  double bytes = 0;
+  double pixels = 0;
+  size_t decoded = 0;
+  FileBuffer data;
+  string path;
+  for (auto id : corpus.images) {
+    corpus.table.path(id, path);
+    auto start = Clock::now();
+    const bool ok = readFileContents(path, data);
+    readTime += Clock::now() - start;
+    bytes += static_cast<double>(data.size());
+
+    start = Clock::now();
+    const cv::Mat image = ok ? decodeImageForHashing(data) : cv::Mat();
+    decodeTime += Clock::now() - start;
+    if (!image.empty()) {
+      ++decoded;
+      pixels += static_cast<double>(image.total());
+    }
+
+    start = Clock::now();
+    corpus.table.calcHashes(id, path, image);
+    hashTime += Clock::now() - start;
+  }
+
+  const auto count = static_cast<double>(corpus.images.size());
+  report("read", bytes / 1e6, "MB", seconds(readTime));
+  report("decode", count, "images", seconds(decodeTime));
+  report("decode pixels", pixels / 1e6, "Mpixels", seconds(decodeTime));
+  report("hash", static_cast<double>(decoded), "images", seconds(hashTime));
+  if (decoded < corpus.images.size()) {
+    cout << "(" << corpus.images.size() - decoded << " images could not be decoded)\n";
+  }
+}
+
+// compares the hashes of the reduced jpeg decode with those of the full
+// color decode, which older versions hashed and which the match threshold
+// of Cluster::maxDistance bits was chosen for. false if an image drifts
+// more than a bit.
+bool checkReducedDecode(const Corpus& corpus) {
+  const int maxDrift = 1;
+  size_t compared = 0;
+  size_t drifted = 0;
+  int worst = 0;
+  double total = 0;
+  string path;
+  for (auto id : corpus.images) {
+    const int drift = reducedDecodeDrift(corpus.table.path(id, path));
+    if (drift < 0) {
+      continue;
+    }
+    ++compared;
+    total += drift;
+    worst = max(worst, drift);
+    drifted += drift > maxDrift;
+  }
+
+  cout << "reduced decode: " << compared << " jpegs, hashes " << (compared > 0 ? total / compared : 0.0)
+       << " bits off a full decode on average, at most " << worst << ", " << drifted << " more than " << maxDrift
+       << " bit\n";
+  return drifted == 0;
+}
+
+// the readers and hashers together, reading one file at a time and through
+// io_uring
+void benchPipeline(const string& root, ThreadPool& pool) {
+  for (unsigned ioDepth : {0u, HashPipeline::defaultIoDepth}) {
+    Corpus corpus;
+    walkCorpus(root, false, pool, corpus);
+
+    MemoryBudget unlimited(0);
+    HashPipeline pipeline(corpus.table, HashPipeline::defaultReaderCount, 0, ioDepth, unlimited);
+    if (ioDepth > 0 && !pipeline.readsAsynchronously()) {
+      cout << "pipeline io_uring: not available\n";
+      continue;
+    }
+    const auto start = Clock::now();
+    for (auto id : corpus.images) {
+      pipeline.submit(id);
+    }
+    pipeline.finish();
+    report(ioDepth > 0 ? "pipeline io_uring" : "pipeline", static_cast<double>(corpus.images.size()),
+           "images", seconds(Clock::now() - start));
+  }
+}
+
+// entries for the paths of the corpus, repeated under made up roots until
+// there are as many as in the cache of a large archive
+void benchCache(const string& root, const Corpus& corpus) {
+  const size_t entryCount = 200000;
+  const string cachePath = root + "/bench.cache";
+  remove(cachePath.c_str());
+  remove((cachePath + ".journal").c_str());
+
+  vector<string> paths;
+  string path;
+  for (size_t copy = 0; paths.size() < entryCount && !corpus.images.empty(); ++copy) {
+    for (auto id : corpus.images) {
+      paths.push_back("/copy" + to_string(copy) + "/" + corpus.table.path(id, path));
+    }
+  }
+
+  Clock::duration putTime{}, saveTime{}, loadTime{}, getTime{};
+  {
+    Cache cache;
+    cache.load(cachePath);
+    CacheEntry entry;
+    entry.hasStamp = entry.hasAverageHash = entry.hasPHash = true;
+    auto start = Clock::now();
+    for (size_t i = 0; i < paths.size(); ++i) {
+      entry.stamp.size = static_cast<int64_t>(i);
+      entry.averageHash.setWord(0, i * 0x9e3779b97f4a7c15ULL);
+      entry.pHash.setWord(0, ~i * 0x9e3779b97f4a7c15ULL);
+      cache.put(paths[i], entry);
+    }
+    putTime = Clock::now() - start;
+
+    start = Clock::now();
+    cache.save();
+    saveTime = Clock::now() - start;
+  }
+  {
+    Cache cache;
+    auto start = Clock::now();
+    cache.load(cachePath);
+    loadTime = Clock::now() - start;
+
+    size_t found = 0;
+    FileStamp stamp;
+    CacheEntry entry;
+    start = Clock::now();
+    for (size_t i = 0; i < paths.size(); ++i) {
+      stamp.size = static_cast<int64_t>(i);
+      found += cache.get(paths[i], stamp, entry);
+    }
+    getTime = Clock::now() - start;
+    if (found != paths.size()) {
+      cout << "cache: found " << found << " of " << paths.size() << " entries\n";
+    }
+  }
+  remove(cachePath.c_str());
+  remove((cachePath + ".journal").c_str());
+
+  const auto count = static_cast<double>(paths.size());
+  report("cache put", count, "entries", seconds(putTime));
+  report("cache save", count, "entries", seconds(saveTime));
+  report("cache load", count, "entries", seconds(loadTime));
+  report("cache get", count, "entries", seconds(getTime));
+}
+
+// times each clustering engine, and counts the groups of the manifest it
+// put into a cluster of their own
+void benchClustering(const string& root, ThreadPool& pool, Corpus& corpus, const vector<CorpusFile>& manifest) {
+  map<string, size_t> groups;
+  map<size_t, size_t> groupSizes;
+  for (auto& file : manifest) {
+    groups[root + "/" + file.path] = file.group;
+    ++groupSizes[file.group];
+  }
+
+  const char* engines[] = {"greedy", "unionfind", "sharded"};
+  for (auto engine : engines) {
+    vector<FileTable::Id> list = corpus.images;
+    Rdutil util(corpus.table, list, pool);
+    util.markitems();
+    util.removeInvalidImages();
+
+    const auto start = Clock::now();
+    if (engine == string("greedy")) {
+      util.buildClusters();
+    } else if (engine == string("unionfind")) {
+      util.buildClustersUnionFind();
+    } else {
+      util.buildClustersSharded();
+    }
+    const double elapsed = seconds(Clock::now() - start);
+    util.removeSingleClusters();
+
+    size_t exact = 0;
+    string path;
+    for (auto& cluster : util.getClusters()) {
+      const auto& files = cluster.getFiles();
+      const auto first = groups.find(corpus.table.path(files.front(), path));
+      bool same = first != groups.end() && files.size() == groupSizes[first->second];
+      for (size_t i = 1; same && i < files.size(); ++i) {
+        const auto other = groups.find(corpus.table.path(files[i], path));
+        same = other != groups.end() && other->second == first->second;
+      }
+      exact += same;
+    }
+
+    report(string("cluster ") + engine, static_cast<double>(list.size()), "images", elapsed);
+    cout << "cluster " << engine << ": " << util.getClusters().size() << " clusters, " << exact << " of "
+         << groupSizes.size() << " groups found exactly\n";
+  }
+}
+
+// writes many small clusters of the corpus images in each results format
+void benchOutput(const string& root, const Corpus& corpus) {
+  if (corpus.images.empty()) {
+    return;
+  }
+  const size_t count = 200000;
+  vector<Cluster> clusters;
+  clusters.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    vector<FileTable::Id> files;
+    for (size_t j = 0; j < 3; ++j) {
+      files.push_back(corpus.images[(3 * i + j) % corpus.images.size()]);
+    }
+    clusters.emplace_back(corpus.table, "", files, static_cast<double>(i % 7) / 2);
+  }
+
+  const pair<const char*, ResultWriter::Format> formats[] = {
+    {"text", ResultWriter::Format::text},
+    {"jsonl", ResultWriter::Format::jsonl},
+    {"binary", ResultWriter::Format::binary},
+  };
+  const string filename = root + "/bench_results";
+  for (auto& format : formats) {
+    const auto start = Clock::now();
+    ResultWriter writer(corpus.table, filename, format.second);
+    for (auto& cluster : clusters) {
+      writer.write(cluster);
+    }
+    if (!writer.finish()) {
+      cerr << "Couldn't write " << filename << endl;
+      break;
+    }
+    const double elapsed = seconds(Clock::now() - start);
+    report(string("output ") + format.first, static_cast<double>(count), "clusters", elapsed);
+    report(string("output ") + format.first, static_cast<double>(writer.bytesWritten()) / 1e6, "MB", elapsed);
+  }
+  remove(filename.c_str());
+}
+
+int generate(int argc, const char* argv[]) {
+  const string root = argv[2];
+  CorpusOptions options;
+  if (argc > 3) {
+    options.images = stoul(argv[3]);
+  }
+  if (argc > 4) {
+    options.variants = stoul(argv[4]);
+  }
+  if (argc > 5) {
+    options.seed = stoull(argv[5]);
+  }
+
+  mkdir(root.c_str(), 0755);
+  const auto start = Clock::now();
+  const auto files = writeImageCorpus(root, options);
+  if (files.size() != options.images * (options.variants + 1) ||
+      !writeCorpusManifest(root + "/" + corpusManifestName, files)) {
+    cerr << "Couldn't write the corpus to " << root << endl;
+    return 1;
+  }
+  cout << "wrote " << files.size() << " images in " << seconds(Clock::now() - start) << " s\n";
+  return 0;
+}
+
+int run(string root) {
+  while (root.size() > 1 && root.back() == '/') {
+    root.pop_back();
+  }
+
+  vector<CorpusFile> manifest;
+  if (!readCorpusManifest(root + "/" + corpusManifestName, manifest)) {
+    cerr << root << " has no " << corpusManifestName << ", write a corpus with bench generate" << endl;
+    return 1;
+  }
+
+  ThreadPool pool;
+  Corpus corpus;
+  benchWalk(root, pool, corpus);
+  benchHashing(corpus);
+  const bool reducedOk = checkReducedDecode(corpus);
+  benchPipeline(root, pool);
+  benchCache(root, corpus);
+  benchClustering(root, pool, corpus, manifest);
+  benchOutput(root, corpus);
+  if (!reducedOk) {
+    cerr << "the reduced decode changes the hashes too much" << endl;
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+  if (argc >= 3 && argv[1] == string("generate")) {
+    return generate(argc, argv);
+  }
+  if (argc == 3 && argv[1] == string("run")) {
+    return run(argv[2]);
+  }
+  cerr << "usage: bench generate DIR [IMAGES [VARIANTS [SEED]]]\n"
+          "       bench run DIR\n";
+  return 1;
+}
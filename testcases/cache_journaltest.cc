@@ -0,0 +1,109 @@
+/*
+   Test for the cache journal: entries put without a save must survive the
+   cache being dropped, as when rdfind is killed, a torn record at the end of
+   the journal must be cut off without losing the ones before it, and save
+   must fold the journal into the cache file.
+   Exits with non zero status on failure.
+*/
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../Cache.hh"
+#include "CacheTestEntries.hh"
+
+using namespace std;
+
+namespace {
+
+const size_t entryCount = 1000;
+
+string name(size_t i) {
+  return "/photos/img" + to_string(i) + ".jpg";
+}
+
+// checks that the entries first to last are there
+bool verify(const Cache& cache, size_t first, size_t last, const char* when) {
+  for (size_t i = first; i < last; ++i) {
+    CacheEntry entry;
+    if (!cache.get(name(i), makeStamp(i), entry) || entry.averageHash.word(0) != i ||
+        entry.pHash.word(0) != ~uint64_t(i)) {
+      cerr << "wrong or missing entry for " << name(i) << " " << when << '\n';
+      return false;
+    }
+  }
+  return true;
+}
+
+off_t fileSize(const string& path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 ? info.st_size : -1;
+}
+
+} // namespace
+
+int main() {
+  const string path = "cache_journaltest." + to_string(getpid()) + ".bin";
+  const string journal = path + ".journal";
+  auto cleanup = [&path, &journal]() {
+    remove(path.c_str());
+    remove(journal.c_str());
+  };
+
+  // a run which is killed before it saves
+  {
+    Cache cache;
+    cache.load(path);
+    for (size_t i = 0; i < entryCount; ++i) {
+      cache.put(name(i), makeEntry(i));
+    }
+  }
+
+  // a crash in the middle of writing a record
+  {
+    ofstream torn(journal.c_str(), ios_base::out | ios_base::binary | ios_base::app);
+    torn.write("\x40\x00\x00\x00garbage", 11);
+  }
+  const off_t tornSize = fileSize(journal);
+
+  {
+    Cache cache;
+    cache.load(path);
+    if (!verify(cache, 0, entryCount, "after replaying the journal")) {
+      cleanup();
+      return 1;
+    }
+    if (fileSize(journal) != tornSize - 11) {
+      cerr << "the torn record was not cut off\n";
+      cleanup();
+      return 1;
+    }
+
+    // the resumed run adds more, then completes
+    for (size_t i = entryCount; i < 2 * entryCount; ++i) {
+      cache.put(name(i), makeEntry(i));
+    }
+    cache.save();
+    if (fileSize(journal) >= tornSize) {
+      cerr << "save did not empty the journal\n";
+      cleanup();
+      return 1;
+    }
+  }
+
+  Cache reloaded;
+  reloaded.load(path);
+  const bool ok = verify(reloaded, 0, 2 * entryCount, "after save and load");
+  cleanup();
+  if (!ok) {
+    return 1;
+  }
+
+  cout << "cache journal test passed\n";
+  return 0;
+}
@@ -0,0 +1,122 @@
+/*
+   Stress test for the cache: every core puts and gets entries at the same
+   time, some of them on names shared with other threads, then the cache is
+   saved, loaded again and verified.
+   Exits with non zero status on failure. Run it under a thread sanitizer
+   to catch races that do not show up as wrong values.
+*/
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../Cache.hh"
+#include "CacheTestEntries.hh"
+
+using namespace std;
+
+namespace {
+
+const size_t namesPerThread = 20000;
+const size_t sharedNames = 500;
+
+string ownName(size_t thread, size_t i) {
+  return "/photos/t" + to_string(thread) + "/img" + to_string(i) + ".jpg";
+}
+
+string sharedName(size_t i) {
+  return "/photos/shared/img" + to_string(i) + ".jpg";
+}
+
+// shared entries are always written with a value matching their name
+uint64_t sharedValue(size_t i) {
+  return 1000000 + i;
+}
+
+bool verifyOwn(const Cache& cache, size_t threadCount) {
+  for (size_t t = 0; t < threadCount; ++t) {
+    for (size_t i = 0; i < namesPerThread; ++i) {
+      const uint64_t value = t * namesPerThread + i;
+      CacheEntry entry;
+      if (!cache.get(ownName(t, i), makeStamp(value), entry) ||
+          entry.averageHash.word(0) != value || entry.pHash.word(0) != ~value) {
+        cerr << "wrong or missing entry for " << ownName(t, i) << '\n';
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+} // namespace
+
+int main() {
+  const size_t threadCount = max(2u, thread::hardware_concurrency());
+  const string path = "cache_stresstest." + to_string(getpid()) + ".bin";
+  atomic<bool> failed{false};
+
+  {
+    Cache cache;
+    cache.load(path);
+
+    vector<thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+      threads.emplace_back([&cache, &failed, t, threadCount]() {
+        for (size_t i = 0; i < namesPerThread; ++i) {
+          const uint64_t value = t * namesPerThread + i;
+          cache.put(ownName(t, i), makeEntry(value));
+
+          // read back one of our own and one of a neighbour, which may not be there yet
+          CacheEntry entry;
+          if (!cache.get(ownName(t, i / 2), makeStamp(t * namesPerThread + i / 2), entry)) {
+            failed = true;
+          }
+          const size_t other = (t + 1) % threadCount;
+          if (cache.get(ownName(other, i), makeStamp(other * namesPerThread + i), entry) &&
+              entry.averageHash.word(0) != other * namesPerThread + i) {
+            failed = true;
+          }
+
+          // contended names
+          const size_t s = (i * 7 + t) % sharedNames;
+          cache.put(sharedName(s), makeEntry(sharedValue(s)));
+          if (cache.get(sharedName(s), makeStamp(sharedValue(s)), entry) &&
+              entry.averageHash.word(0) != sharedValue(s)) {
+            failed = true;
+          }
+        }
+      });
+    }
+
+    for (auto& t : threads) {
+      t.join();
+    }
+
+    if (failed || !verifyOwn(cache, threadCount)) {
+      cerr << "inconsistent cache while running\n";
+      remove(path.c_str());
+      remove((path + ".journal").c_str());
+      return 1;
+    }
+
+    cache.save();
+  }
+
+  Cache reloaded;
+  reloaded.load(path);
+  remove(path.c_str());
+  remove((path + ".journal").c_str());
+  if (!verifyOwn(reloaded, threadCount)) {
+    cerr << "inconsistent cache after save and load\n";
+    return 1;
+  }
+
+  cout << "cache stress test passed with " << threadCount << " threads\n";
+  return 0;
+}
@@ -0,0 +1,232 @@
+/*
+   Stress test for the order independent clustering: files with synthetic
+   hashes, in groups of close hashes, are clustered by the union-find and
+   the sharded engine with several thread counts and in shuffled orders.
+   All runs must give the clusters of a plain serial reference. Then many
+   threads unite and find on one UnionFind at once, which must end up with
+   the sets of the serial reference.
+   Exits with non zero status on failure. Run it under a thread sanitizer
+   to catch races that do not show up as wrong values.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "../Cache.hh"
+#include "../FileTable.hh"
+#include "../Rdutil.hh"
+#include "../ThreadPool.hh"
+#include "../UnionFind.hh"
+
+using namespace std;
+
+namespace {
+
+const size_t groupCount = 400;
+const size_t fileCount = 3000;
+// fewer than the ids and within small ranges, so there are many sets
+const size_t edgeCount = 2000;
+
+uint64_t flipBits(uint64_t hash, size_t bits, mt19937_64& random) {
+  for (size_t i = 0; i < bits; ++i) {
+    hash ^= uint64_t(1) << (random() % 64);
+  }
+  return hash;
+}
+
+// files in groups of hashes a few bits apart, some groups chained to the one
+// before so clusters span more than the distance
+vector<FileTable::Id> addFiles(FileTable& table, Cache& cache) {
+  mt19937_64 random(20261016);
+  vector<uint64_t> groups;
+  for (size_t g = 0; g < groupCount; ++g) {
+    groups.push_back(g % 3 != 0 ? flipBits(groups.back(), 2, random) : random());
+  }
+
+  vector<FileTable::Id> files;
+  const auto dir = table.addDirectory("photos");
+  for (size_t i = 0; i < fileCount; ++i) {
+    struct stat info = {};
+    info.st_size = static_cast<off_t>(i + 1);
+    info.st_ino = i + 1;
+    const string name = "img" + to_string(i) + ".jpg";
+    const auto id = table.add(dir, name, 0, 1, info);
+
+    const uint64_t group = groups[random() % groups.size()];
+    CacheEntry entry;
+    entry.averageHash.setWord(0, flipBits(group, random() % 3, random));
+    entry.pHash.setWord(0, flipBits(group, random() % 3, random));
+    entry.hasAverageHash = true;
+    entry.hasPHash = true;
+    entry.stamp = table.stamp(id);
+    entry.hasStamp = true;
+    string path;
+    cache.put(table.path(id, path), entry);
+    table.loadCachedHashes(id, path);
+    files.push_back(id);
+  }
+  return files;
+}
+
+bool isClose(const FileTable& table, FileTable::Id a, FileTable::Id b) {
+  const int limit = static_cast<int>(Cluster::maxDistance);
+  return __builtin_popcountll(table.pHash(a) ^ table.pHash(b)) <= limit &&
+         __builtin_popcountll(table.aHash(a) ^ table.aHash(b)) <= limit;
+}
+
+// the clusters as text, files and cluster in the order the engine gives them
+string describe(const FileTable& table, const vector<Cluster>& clusters) {
+  string result;
+  string path;
+  for (auto& cluster : clusters) {
+    result += "# " + to_string(cluster.getDistance()) + '\n';
+    for (auto f : cluster.getFiles()) {
+      result += table.path(f, path) + '\n';
+    }
+  }
+  return result;
+}
+
+// the clusters serially, every pair compared and joined by flooding
+string referenceClusters(const FileTable& table, vector<FileTable::Id> files) {
+  sort(files.begin(), files.end(), FileTable::PathOrder(table));
+  vector<Cluster> clusters;
+  vector<char> done(files.size(), 0);
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (done[i]) {
+      continue;
+    }
+    done[i] = 1;
+    vector<size_t> members{i};
+    for (size_t m = 0; m < members.size(); ++m) {
+      for (size_t j = 0; j < files.size(); ++j) {
+        if (!done[j] && isClose(table, files[members[m]], files[j])) {
+          done[j] = 1;
+          members.push_back(j);
+        }
+      }
+    }
+    sort(members.begin(), members.end());
+
+    clusters.emplace_back(table, "", vector<FileTable::Id>({files[members.front()]}), 0.0);
+    auto& cluster = clusters.back();
+    for (size_t m = 1; m < members.size(); ++m) {
+      double distance = 0.0;
+      cluster.calcDistance(files[members[m]], distance);
+      cluster.setDistance(max(cluster.getDistance(), distance));
+      cluster.add(files[members[m]]);
+    }
+  }
+  return describe(table, clusters);
+}
+
+bool checkEngines(FileTable& table, const vector<FileTable::Id>& files) {
+  const string expected = referenceClusters(table, files);
+  const size_t threadCounts[] = {1, 2, 3, max(4u, thread::hardware_concurrency())};
+  bool passed = true;
+  unsigned seed = 0;
+  for (auto threads : threadCounts) {
+    ThreadPool pool(threads);
+    for (int order = 0; order < 3; ++order) {
+      vector<FileTable::Id> list = files;
+      shuffle(list.begin(), list.end(), mt19937(++seed));
+      Rdutil unionFind(table, list, pool);
+      unionFind.buildClustersUnionFind();
+      Rdutil sharded(table, list, pool);
+      sharded.buildClustersSharded();
+
+      if (describe(table, unionFind.getClusters()) != expected) {
+        cerr << "unionfind differs from the reference with " << threads << " threads\n";
+        passed = false;
+      }
+      if (describe(table, sharded.getClusters()) != expected) {
+        cerr << "sharded differs from the reference with " << threads << " threads\n";
+        passed = false;
+      }
+    }
+  }
+  return passed;
+}
+
+// every thread unites all edges in an order of its own while finding
+bool checkUnionFind() {
+  const size_t count = fileCount;
+  mt19937_64 random(7);
+  vector<pair<uint32_t, uint32_t>> edges;
+  for (size_t i = 0; i < edgeCount; ++i) {
+    const auto a = static_cast<uint32_t>(random() % count);
+    const auto b = static_cast<uint32_t>(min<size_t>(count - 1, a + random() % 8));
+    edges.emplace_back(a, b);
+  }
+
+  // the smallest id of each set
+  vector<uint32_t> expected(count);
+  iota(expected.begin(), expected.end(), 0);
+  auto root = [&expected](uint32_t id) {
+    while (expected[id] != id) {
+      id = expected[id];
+    }
+    return id;
+  };
+  for (auto& edge : edges) {
+    const auto a = root(edge.first);
+    const auto b = root(edge.second);
+    expected[max(a, b)] = min(a, b);
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    expected[i] = root(i);
+  }
+
+  const size_t threadCount = max(4u, thread::hardware_concurrency());
+  bool passed = true;
+  for (int round = 0; round < 20; ++round) {
+    UnionFind sets(count);
+    vector<thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+      threads.emplace_back([&sets, edges, t, round]() mutable {
+        shuffle(edges.begin(), edges.end(), mt19937(static_cast<unsigned>(round * 1000 + t)));
+        for (auto& edge : edges) {
+          sets.unite(edge.first, edge.second);
+          sets.find(edge.second);
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      if (sets.find(i) != expected[i]) {
+        passed = false;
+      }
+    }
+  }
+  if (!passed) {
+    cerr << "concurrent unions gave other sets than the serial ones\n";
+  }
+  return passed;
+}
+
+} // namespace
+
+int main() {
+  Cache cache;
+  FileTable table(&cache);
+  const auto files = addFiles(table, cache);
+
+  const bool engines = checkEngines(table, files);
+  const bool unionFind = checkUnionFind();
+  if (!engines || !unionFind) {
+    return 1;
+  }
+
+  cout << "clustering stress test passed with " << files.size() << " files\n";
+  return 0;
+}
@@ -0,0 +1,70 @@
+/*
+   Test for the reduced decode: a small corpus of large jpegs, the same on
+   every run, is hashed from the decode rdfind uses and from the full color
+   decode older versions used. No image may drift more than a bit, or hashes
+   cached by older versions would no longer match new ones.
+   Exits with non zero status on failure.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ImageCorpus.hh"
+
+using namespace std;
+
+namespace {
+
+const int maxDrift = 1;
+
+} // namespace
+
+int main() {
+  const string root = "decode_drifttest." + to_string(getpid());
+  if (mkdir(root.c_str(), 0755) != 0) {
+    cerr << "Couldn't create " << root << endl;
+    return 1;
+  }
+
+  // large enough for each jpeg reduction, and a single directory
+  CorpusOptions options;
+  options.images = 12;
+  options.variants = 2;
+  options.depth = 0;
+  options.maxSide = 4800;
+  options.seed = 20261016;
+  const auto files = writeImageCorpus(root, options);
+
+  size_t compared = 0;
+  int worst = 0;
+  for (auto& file : files) {
+    const string path = root + "/" + file.path;
+    const int drift = reducedDecodeDrift(path);
+    remove(path.c_str());
+    if (drift < 0) {
+      continue;
+    }
+    ++compared;
+    if (drift > maxDrift) {
+      cerr << file.path << " (" << transformName(file.transform) << ") drifts " << drift << " bits\n";
+    }
+    worst = max(worst, drift);
+  }
+  rmdir(root.c_str());
+
+  if (files.size() != options.images * (options.variants + 1) || compared == 0) {
+    cerr << "the corpus was not written, or has no reduced jpegs\n";
+    return 1;
+  }
+  if (worst > maxDrift) {
+    return 1;
+  }
+
+  cout << "decode drift test passed, " << compared << " reduced jpegs at most " << worst << " bits off\n";
+  return 0;
+}
@@ -0,0 +1,125 @@
+/*
+   Test for the hamming distance kernels: every kernel this cpu supports is
+   run over random hashes, at every length up to a few vector widths and at
+   offsets into the array, so the tails and unaligned loads are covered.
+   The distances must be those of the scalar kernel and of a plain popcount,
+   the largest distance that too, or above the limit once it is exceeded.
+   Exits with non zero status on failure.
+*/
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../HammingDistance.hh"
+
+using namespace std;
+
+namespace {
+
+// lengths up to this are all run, then a few larger ones
+const size_t maxShortLength = 80;
+const size_t longLengths[] = {255, 256, 257, 1000, 4099};
+const size_t maxOffset = 7;
+const int roundsPerLength = 20;
+
+int distance(uint64_t a, uint64_t b) {
+  return __builtin_popcountll(a ^ b);
+}
+
+// some hashes close to the query, so limits in between are met and missed
+vector<uint64_t> randomHashes(uint64_t query, size_t count, mt19937_64& random) {
+  vector<uint64_t> hashes(count);
+  for (auto& h : hashes) {
+    h = random() % 2 ? random() : query ^ (random() & random() & random());
+  }
+  return hashes;
+}
+
+// the failures of the active kernel on count hashes from hashes
+size_t checkKernel(const char* name, uint64_t query, const uint64_t* hashes, size_t count, int limit) {
+  size_t failures = 0;
+  int expectedMax = 0;
+  vector<uint8_t> distances(count + 1, 0xff);
+  hammingDistances(query, hashes, count, distances.data());
+  for (size_t i = 0; i < count; ++i) {
+    const int expected = distance(query, hashes[i]);
+    expectedMax = max(expectedMax, expected);
+    if (distances[i] != expected) {
+      ++failures;
+    }
+  }
+  if (distances[count] != 0xff) {
+    cerr << name << " writes past " << count << " distances\n";
+    ++failures;
+  }
+
+  if (hammingMaxDistance(query, hashes, count, 64) != expectedMax) {
+    cerr << name << " has another largest distance over " << count << " hashes\n";
+    ++failures;
+  }
+  const int limited = hammingMaxDistance(query, hashes, count, limit);
+  if (expectedMax <= limit ? limited != expectedMax : limited <= limit) {
+    cerr << name << " gives " << limited << " with limit " << limit << " over " << count
+         << " hashes, the largest distance is " << expectedMax << "\n";
+    ++failures;
+  }
+  return failures;
+}
+
+} // namespace
+
+int main() {
+  vector<size_t> lengths;
+  for (size_t length = 0; length <= maxShortLength; ++length) {
+    lengths.push_back(length);
+  }
+  lengths.insert(lengths.end(), begin(longLengths), end(longLengths));
+
+  const char* kernels[] = {"scalar", "avx2", "avx512"};
+  size_t failures = 0;
+  size_t kernelsRun = 0;
+  for (auto name : kernels) {
+    if (!selectHammingKernel(name)) {
+      cout << name << ": not supported on this cpu, skipped\n";
+      continue;
+    }
+    ++kernelsRun;
+
+    // the same hashes for every kernel
+    mt19937_64 random(20261016);
+    size_t kernelFailures = 0;
+    for (auto length : lengths) {
+      for (int round = 0; round < roundsPerLength; ++round) {
+        const uint64_t query = random();
+        const size_t offset = random() % (maxOffset + 1);
+        const auto hashes = randomHashes(query, length + offset, random);
+        const int limit = static_cast<int>(random() % 65);
+        kernelFailures += checkKernel(name, query, hashes.data() + offset, length, limit);
+
+        // the scalar kernel as the reference for the others
+        selectHammingKernel("scalar");
+        vector<uint8_t> scalar(length);
+        hammingDistances(query, hashes.data() + offset, length, scalar.data());
+        selectHammingKernel(name);
+        vector<uint8_t> distances(length);
+        hammingDistances(query, hashes.data() + offset, length, distances.data());
+        if (distances != scalar) {
+          cerr << name << " differs from scalar over " << length << " hashes\n";
+          ++kernelFailures;
+        }
+      }
+    }
+    if (kernelFailures > 0) {
+      cerr << name << ": " << kernelFailures << " failures\n";
+    }
+    failures += kernelFailures;
+  }
+
+  if (kernelsRun == 0 || failures > 0) {
+    return 1;
+  }
+  cout << "hamming kernel test passed with " << kernelsRun << " kernels\n";
+  return 0;
+}
@@ -0,0 +1,72 @@
+/*
+   Performance test for the hamming distance kernels. Not meant
+   to be run for regular testing.
+   Build with "make hamming_speedtest", run without arguments.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../HammingDistance.hh"
+
+using namespace std;
+
+namespace {
+
+// number of hashes in the array each query is compared to, about the size of
+// a large burst cluster
+const size_t hashCount = 4096;
+const size_t queryCount = 20000;
+
+double comparisonsPerSecond(chrono::steady_clock::duration elapsed) {
+  const auto seconds = chrono::duration<double>(elapsed).count();
+  return static_cast<double>(hashCount * queryCount) / seconds;
+}
+
+} // namespace
+
+int main() {
+  mt19937_64 random(42);
+  vector<uint64_t> hashes(hashCount);
+  for (auto& h : hashes) {
+    h = random();
+  }
+
+  vector<uint64_t> queries(queryCount);
+  for (auto& q : queries) {
+    q = random();
+  }
+
+  vector<uint8_t> distances(hashCount);
+  const char* kernels[] = {"scalar", "avx2", "avx512"};
+  for (auto name : kernels) {
+    if (!selectHammingKernel(name)) {
+      cout << name << ": not supported on this cpu\n";
+      continue;
+    }
+
+    // no limit, so every hash is visited
+    long long checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto q : queries) {
+      checksum += hammingMaxDistance(q, hashes.data(), hashes.size(), 64);
+    }
+    const auto maxElapsed = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    for (auto q : queries) {
+      hammingDistances(q, hashes.data(), hashes.size(), distances.data());
+      checksum += distances[q % hashCount];
+    }
+    const auto allElapsed = chrono::steady_clock::now() - start;
+
+    cout << name << ": max " << comparisonsPerSecond(maxElapsed) / 1e6
+         << " M comparisons/s, all " << comparisonsPerSecond(allElapsed) / 1e6
+         << " M comparisons/s (checksum " << checksum << ")\n";
+  }
+
+  return 0;
+}
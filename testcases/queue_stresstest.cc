@@ -0,0 +1,96 @@
+/*
+   Stress test for the bounded queue: producers push numbered items through a
+   small queue to consumers, then the queue is closed. Every item must arrive
+   exactly once, and the items of one producer in the order they were pushed.
+   Exits with non zero status on failure. Run it under a thread sanitizer
+   to catch races that do not show up as wrong values.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../BoundedQueue.hh"
+
+using namespace std;
+
+namespace {
+
+const size_t itemsPerProducer = 200000;
+
+struct Item {
+  size_t producer = 0;
+  size_t sequence = 0;
+  // a non trivial payload, to see that moved values are not lost
+  shared_ptr<size_t> payload;
+};
+
+} // namespace
+
+int main() {
+  const size_t producerCount = max(2u, thread::hardware_concurrency() / 2);
+  const size_t consumerCount = producerCount;
+  // small, so the producers wait on full and the consumers on empty
+  BoundedQueue<Item> queue(16);
+
+  atomic<bool> failed{false};
+  atomic<size_t> activeProducers{producerCount};
+  vector<vector<char>> seen(producerCount, vector<char>(itemsPerProducer, 0));
+
+  vector<thread> threads;
+  for (size_t p = 0; p < producerCount; ++p) {
+    threads.emplace_back([&queue, &activeProducers, p]() {
+      for (size_t i = 0; i < itemsPerProducer; ++i) {
+        Item item;
+        item.producer = p;
+        item.sequence = i;
+        item.payload = make_shared<size_t>(p * itemsPerProducer + i);
+        queue.push(move(item));
+      }
+      if (activeProducers.fetch_sub(1) == 1) {
+        queue.close();
+      }
+    });
+  }
+
+  for (size_t c = 0; c < consumerCount; ++c) {
+    threads.emplace_back([&queue, &failed, &seen, producerCount]() {
+      // per producer, the items this consumer gets must come in order
+      vector<size_t> next(producerCount, 0);
+      Item item;
+      while (queue.pop(item)) {
+        if (item.producer >= producerCount || item.sequence >= itemsPerProducer ||
+            item.sequence < next[item.producer] || !item.payload ||
+            *item.payload != item.producer * itemsPerProducer + item.sequence) {
+          failed = true;
+          continue;
+        }
+        next[item.producer] = item.sequence + 1;
+        // each slot is written by the one consumer getting the item
+        seen[item.producer][item.sequence]++;
+      }
+    });
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  for (const auto& items : seen) {
+    if (any_of(items.begin(), items.end(), [](char count) { return count != 1; })) {
+      failed = true;
+    }
+  }
+
+  if (failed) {
+    cerr << "items were lost, duplicated or reordered\n";
+    return 1;
+  }
+
+  cout << "queue stress test passed with " << producerCount << " producers and "
+       << consumerCount << " consumers\n";
+  return 0;
+}
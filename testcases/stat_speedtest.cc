@@ -0,0 +1,121 @@
+/*
+   Performance test for stat:ing the files of a tree one by one, and in
+   batches through io_uring. Not meant to be run for regular testing.
+   Build with "make stat_speedtest", run with the directories to stat. Run
+   as root to have the page cache dropped before each pass, otherwise the
+   second pass sees a warm cache and the numbers are not comparable.
+*/
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../StatBatch.hh"
+
+using namespace std;
+
+namespace {
+
+struct Directory {
+  string path;
+  vector<string> names;
+};
+
+// every directory below root, with the names in it
+void listTree(const string& root, vector<Directory>& directories) {
+  DIR* dirp = opendir(root.c_str());
+  if (dirp == nullptr) {
+    return;
+  }
+
+  Directory directory{root, {}};
+  vector<string> subdirs;
+  while (const struct dirent* d = readdir(dirp)) {
+    const string name = d->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    directory.names.push_back(name);
+    if (d->d_type == DT_DIR) {
+      subdirs.push_back(root + "/" + name);
+    }
+  }
+  closedir(dirp);
+  directories.push_back(move(directory));
+
+  for (auto& subdir : subdirs) {
+    listTree(subdir, directories);
+  }
+}
+
+// true if the page, dentry and inode caches could be dropped
+bool dropCaches() {
+  sync();
+  ofstream dropper("/proc/sys/vm/drop_caches");
+  dropper << "3\n";
+  return static_cast<bool>(dropper.flush());
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+  if (argc < 2) {
+    cerr << "usage: stat_speedtest DIRECTORY ...\n";
+    return 1;
+  }
+
+  vector<Directory> directories;
+  for (int i = 1; i < argc; ++i) {
+    listTree(argv[i], directories);
+  }
+  size_t total = 0;
+  for (auto& d : directories) {
+    total += d.names.size();
+  }
+  cout << total << " names in " << directories.size() << " directories\n";
+
+  const char* engines[] = {"stat", "io_uring"};
+  for (auto engine : engines) {
+    const bool useIoUring = engine == string("io_uring");
+    StatBatch batch(useIoUring);
+    if (useIoUring && !batch.usesIoUring()) {
+      cout << engine << ": not available\n";
+      continue;
+    }
+    const bool cold = dropCaches();
+
+    size_t failed = 0;
+    vector<const char*> names;
+    vector<struct stat> infos;
+    vector<int> results;
+    const auto start = chrono::steady_clock::now();
+    for (auto& d : directories) {
+      const int fd = open(d.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (fd < 0) {
+        continue;
+      }
+      names.clear();
+      for (auto& name : d.names) {
+        names.push_back(name.c_str());
+      }
+      batch.statAt(fd, names, AT_SYMLINK_NOFOLLOW, infos, results);
+      for (auto r : results) {
+        failed += r != 0;
+      }
+      close(fd);
+    }
+    const auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << engine << ": " << static_cast<double>(total) / seconds << " stats/s, "
+         << (cold ? "cold" : "warm") << " cache (" << failed << " failed)\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Ensures a file given directly in / is found there, not relative to the
+# current directory.
+#
+# The file is not written to the real /: the test runs again in a mount
+# namespace of its own, chrooted to a tmpfs with the directories of / bound
+# into it. Skipped where that is not possible.
+
+
+if [ -z "$RDFIND_ROOTLEVEL_CHROOT" ] ; then
+   if ! unshare -rm true 2>/dev/null ; then
+      echo "$(basename $0): can not make a mount namespace, skipping"
+      exit 77
+   fi
+   newroot=$(mktemp -d -t rdfindrootlevel.d.XXXXXXXXXXXX)
+   status=0
+   RDFIND_ROOTLEVEL_CHROOT=1 unshare -rm sh -c '
+      mount -t tmpfs rdfindroot "$1" || exit 77
+      for entry in /* ; do
+         if [ -L "$entry" ] ; then
+            cp -P "$entry" "$1$entry" || exit 77
+         elif [ -d "$entry" ] ; then
+            mkdir "$1$entry" && mount --rbind "$entry" "$1$entry" || exit 77
+         fi
+      done
+      exec chroot "$1" sh -c "cd \"\$1\" && exec sh \"\$2\"" sh "$2" "$3"
+   ' sh "$newroot" "$PWD" "$(readlink -f "$0")" || status=$?
+   rmdir "$newroot"
+   exit $status
+fi
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+rootfile=/rdfind_rootlevel_test_$$.bmp
+if ! touch $rootfile 2>/dev/null ; then
+   echo "$me: can not write to /, skipping"
+   exit 77
+fi
+trap "rm -f $rootfile;cleanup" INT QUIT EXIT
+
+#an 8x8 pixel, 24 bit bmp with random pixels
+makebmp() {
+   printf 'BM\366\000\000\000\000\000\000\000\066\000\000\000' >$1
+   printf '\050\000\000\000\010\000\000\000\010\000\000\000\001\000\030\000' >>$1
+   printf '\000\000\000\000\300\000\000\000\023\013\000\000\023\013\000\000' >>$1
+   printf '\000\000\000\000\000\000\000\000' >>$1
+   head -c192 /dev/urandom >>$1
+}
+
+reset_teststate
+makebmp $rootfile
+cp $rootfile copy.bmp
+#a file with the same name in the current directory must not be picked up
+echo "not an image" >$(basename $rootfile)
+
+$rdfind $rootfile copy.bmp
+verify grep -q "^[0-9]*:[0-9]*[[:space:]]$rootfile\$" rdfind_results.txt
+verify grep -q "^[0-9]*:[0-9]*[[:space:]]copy.bmp\$" rdfind_results.txt
+
+dbgecho "all is good in this test!"